@@ -22,6 +22,7 @@
 #include "bintool.h"
 #include "metadata.h"
 #include "errors.h"
+#include "crc32.h"
 
 // todo test with a holey binary
 
@@ -430,13 +431,13 @@ std::unique_ptr<block> get_last_block(std::vector<uint8_t> &bin, uint32_t storag
 }
 
 
-block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::unique_ptr<block> &first_block, bool set_others_ignored) {
+static uint32_t bin_highest_address(uint32_t storage_addr, uint32_t bin_size) {
     uint32_t highest_ram_address = 0;
     uint32_t highest_flash_address = 0;
     bool no_flash = false;
 
     const uint32_t paddr = storage_addr;
-    const uint32_t psize = bin.size();
+    const uint32_t psize = bin_size;
     if (paddr >= 0x20000000 && paddr < 0x20080000) {
         highest_ram_address = std::max(paddr + psize, highest_ram_address);
     } else if (paddr >= 0x10000000 && paddr < 0x20000000) {
@@ -446,7 +447,6 @@ block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::uni
     if (highest_flash_address == 0) {
         no_flash = true;
     }
-    uint32_t highest_address = no_flash ? highest_ram_address : highest_flash_address;
 
     if (no_flash) {
         DEBUG_LOG("RAM %08x ", highest_ram_address);
@@ -455,29 +455,11 @@ block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::uni
         DEBUG_LOG("FLASH %08x\n", highest_flash_address);
     }
 
-    int32_t loop_start_rel = 0;
-    uint32_t new_block_addr = 0;
-    std::unique_ptr<block> new_first_block;
-    if (!first_block->next_block_rel) {
-        set_next_block(bin, storage_addr, first_block, highest_address);
-        loop_start_rel = -first_block->next_block_rel;
-        new_block_addr = first_block->physical_addr + first_block->next_block_rel;
-        if (set_others_ignored) set_block_ignored(bin, storage_addr, first_block->physical_addr);
-    } else {
-        DEBUG_LOG("Ooh, there is already a block loop - lets find it's end\n");
-        auto all_blocks = get_all_blocks(bin, storage_addr, first_block);
-        for (auto &block : all_blocks) {
-            if (set_others_ignored) set_block_ignored(bin, storage_addr, block->physical_addr);
-        }
-        new_first_block = std::move(all_blocks.back());
-        set_next_block(bin, storage_addr, new_first_block, highest_address);
-        new_block_addr = new_first_block->physical_addr + new_first_block->next_block_rel;
-        loop_start_rel = first_block->physical_addr - new_block_addr;
-    }
-    if (highest_address != new_block_addr) {
-        fail(ERROR_UNKNOWN, "Next block not at highest address %08x %08x\n", (int)highest_address, (int)(new_block_addr));
-    }
+    return no_flash ? highest_ram_address : highest_flash_address;
+}
 
+
+static block new_block_at(uint32_t new_block_addr, int32_t loop_start_rel, std::unique_ptr<block> &first_block, std::unique_ptr<block> &new_first_block) {
     // loop back to first block
     block new_block(new_block_addr, loop_start_rel);
     // check if last block has an image_def
@@ -511,117 +493,68 @@ block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::uni
 }
 
 
-// Checksum stuff
-uint32_t poly8_lookup[256] =
-{
- 0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA,
- 0x076DC419, 0x706AF48F, 0xE963A535, 0x9E6495A3,
- 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
- 0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91,
- 0x1DB71064, 0x6AB020F2, 0xF3B97148, 0x84BE41DE,
- 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
- 0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC,
- 0x14015C4F, 0x63066CD9, 0xFA0F3D63, 0x8D080DF5,
- 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
- 0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B,
- 0x35B5A8FA, 0x42B2986C, 0xDBBBC9D6, 0xACBCF940,
- 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
- 0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116,
- 0x21B4F4B5, 0x56B3C423, 0xCFBA9599, 0xB8BDA50F,
- 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
- 0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D,
- 0x76DC4190, 0x01DB7106, 0x98D220BC, 0xEFD5102A,
- 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
- 0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818,
- 0x7F6A0DBB, 0x086D3D2D, 0x91646C97, 0xE6635C01,
- 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
- 0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457,
- 0x65B0D9C6, 0x12B7E950, 0x8BBEB8EA, 0xFCB9887C,
- 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
- 0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2,
- 0x4ADFA541, 0x3DD895D7, 0xA4D1C46D, 0xD3D6F4FB,
- 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
- 0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9,
- 0x5005713C, 0x270241AA, 0xBE0B1010, 0xC90C2086,
- 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
- 0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4,
- 0x59B33D17, 0x2EB40D81, 0xB7BD5C3B, 0xC0BA6CAD,
- 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
- 0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683,
- 0xE3630B12, 0x94643B84, 0x0D6D6A3E, 0x7A6A5AA8,
- 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
- 0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE,
- 0xF762575D, 0x806567CB, 0x196C3671, 0x6E6B06E7,
- 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
- 0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5,
- 0xD6D6A3E8, 0xA1D1937E, 0x38D8C2C4, 0x4FDFF252,
- 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
- 0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60,
- 0xDF60EFC3, 0xA867DF55, 0x316E8EEF, 0x4669BE79,
- 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
- 0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F,
- 0xC5BA3BBE, 0xB2BD0B28, 0x2BB45A92, 0x5CB36A04,
- 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
- 0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A,
- 0x9C0906A9, 0xEB0E363F, 0x72076785, 0x05005713,
- 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
- 0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21,
- 0x86D3D2D4, 0xF1D4E242, 0x68DDB3F8, 0x1FDA836E,
- 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
- 0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C,
- 0x8F659EFF, 0xF862AE69, 0x616BFFD3, 0x166CCF45,
- 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
- 0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB,
- 0xAED16A4A, 0xD9D65ADC, 0x40DF0B66, 0x37D83BF0,
- 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
- 0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6,
- 0xBAD03605, 0xCDD70693, 0x54DE5729, 0x23D967BF,
- 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
- 0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-};
-
-uint32_t crc32_byte(const uint8_t *p, uint32_t bytelength)
-{
-	uint32_t crc = 0xffffffff;
-	while (bytelength-- !=0) crc = poly8_lookup[((uint8_t) crc ^ *(p++))] ^ (crc >> 8);
-	return crc;
-}
+block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::unique_ptr<block> &first_block, bool set_others_ignored) {
+    uint32_t highest_address = bin_highest_address(storage_addr, bin.size());
 
-uint8_t rev_8(uint8_t b) {
-    b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-    b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-    b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-    return b;
-}
+    int32_t loop_start_rel = 0;
+    uint32_t new_block_addr = 0;
+    std::unique_ptr<block> new_first_block;
+    if (!first_block->next_block_rel) {
+        set_next_block(bin, storage_addr, first_block, highest_address);
+        loop_start_rel = -first_block->next_block_rel;
+        new_block_addr = first_block->physical_addr + first_block->next_block_rel;
+        if (set_others_ignored) set_block_ignored(bin, storage_addr, first_block->physical_addr);
+    } else {
+        DEBUG_LOG("Ooh, there is already a block loop - lets find it's end\n");
+        auto all_blocks = get_all_blocks(bin, storage_addr, first_block);
+        for (auto &block : all_blocks) {
+            if (set_others_ignored) set_block_ignored(bin, storage_addr, block->physical_addr);
+        }
+        new_first_block = std::move(all_blocks.back());
+        set_next_block(bin, storage_addr, new_first_block, highest_address);
+        new_block_addr = new_first_block->physical_addr + new_first_block->next_block_rel;
+        loop_start_rel = first_block->physical_addr - new_block_addr;
+    }
+    if (highest_address != new_block_addr) {
+        fail(ERROR_UNKNOWN, "Next block not at highest address %08x %08x\n", (int)highest_address, (int)(new_block_addr));
+    }
 
-uint32_t rev_32(uint32_t b) {
-    uint8_t b0 = rev_8(b >> 24);
-    uint8_t b1 = rev_8(b >> 16);
-    uint8_t b2 = rev_8(b >> 8);
-    uint8_t b3 = rev_8(b);
-    return (b3 << 24) | (b2 << 16) | (b1 << 8) | b0;
+    return new_block_at(new_block_addr, loop_start_rel, first_block, new_first_block);
 }
 
-void crc32(const uint8_t *data, size_t len, uint32_t* cs_out) {
-    uint8_t rev_data[252] = {};
-    for (size_t i=0; i < sizeof(rev_data); i++) {
-        rev_data[i] = rev_8(data[i]);
-    }
 
-    uint32_t crc = crc32_byte(rev_data, sizeof(rev_data));
+block place_new_block(uint32_t storage_addr, uint32_t bin_size, std::unique_ptr<block> &first_block, get_more_bin_cb more_cb, uint32_t &patch_offset, uint32_t &patch_value) {
+    uint32_t highest_address = bin_highest_address(storage_addr, bin_size);
 
-    crc = rev_32(crc);
+    std::unique_ptr<block> new_first_block;
+    block *last_block = first_block.get();
+    if (first_block->next_block_rel) {
+        DEBUG_LOG("Ooh, there is already a block loop - lets find it's end\n");
+        std::vector<uint8_t> bin;
+        auto all_blocks = get_all_blocks(bin, storage_addr, first_block, more_cb);
+        new_first_block = std::move(all_blocks.back());
+        last_block = new_first_block.get();
+    }
+    // Same change as set_next_block, but left for the caller to make
+    patch_offset = last_block->physical_addr + last_block->next_block_rel_index * 4 - storage_addr;
+    patch_value = highest_address - last_block->physical_addr;
+    last_block->next_block_rel = patch_value;
+    uint32_t new_block_addr = last_block->physical_addr + last_block->next_block_rel;
+    int32_t loop_start_rel = first_block->physical_addr - new_block_addr;
+    if (highest_address != new_block_addr) {
+        fail(ERROR_UNKNOWN, "Next block not at highest address %08x %08x\n", (int)highest_address, (int)(new_block_addr));
+    }
 
-    *cs_out = crc;
+    return new_block_at(new_block_addr, loop_start_rel, first_block, new_first_block);
 }
 
-uint32_t calc_checksum(std::vector<uint8_t> bin) {
-    assert(bin.size() == 252);
 
-    uint32_t checksum = 0;
-    crc32(bin.data(), bin.size(), &checksum);
+// Checksum stuff
+uint32_t calc_checksum(const std::vector<uint8_t> &bin) {
+    assert(bin.size() == 252);
 
-    return checksum;
+    // boot2 checksum is the MSB-first CRC32 with an initial value of 0xffffffff and no final XOR
+    return crc32_msb_update(0xffffffff, bin.data(), bin.size());
 }
 
 
@@ -872,13 +805,11 @@ std::vector<uint8_t> hash_andor_sign(std::vector<uint8_t> bin, uint32_t storage_
 }
 
 
-void verify_block(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *block, verified_t &hash_verified, verified_t &sig_verified, get_more_bin_cb more_cb) {
+std::vector<uint8_t> get_verify_data(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *block, get_more_bin_cb more_cb) {
     std::shared_ptr<load_map_item> load_map = block->get_item<load_map_item>();
     std::shared_ptr<hash_def_item> hash_def = block->get_item<hash_def_item>();
-    hash_verified = none;
-    sig_verified = none;
     if (load_map == nullptr || hash_def == nullptr) {
-        return;
+        return {};
     }
     std::vector<uint8_t> to_hash = get_lm_hash_data(bin, storage_addr, runtime_addr, block, more_cb, false);
 
@@ -900,6 +831,17 @@ void verify_block(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runt
     auto block_hashed_contents = words_to_lsb_bytes(tmp_words.begin(), tmp_words.end());
     std::copy(block_hashed_contents.begin(), block_hashed_contents.end(), std::back_inserter(to_hash));
 
+    return to_hash;
+}
+
+
+void verify_block_data(const std::vector<uint8_t> &to_hash, block *block, verified_t &hash_verified, verified_t &sig_verified) {
+    hash_verified = none;
+    sig_verified = none;
+    if (block->get_item<load_map_item>() == nullptr || block->get_item<hash_def_item>() == nullptr) {
+        return;
+    }
+
     message_digest_t sha256;
     message_digest_t block_sha256;
     sha256_buffer(to_hash.data(), to_hash.size(), &sha256);
@@ -941,6 +883,11 @@ void verify_block(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runt
 }
 
 
+void verify_block(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *block, verified_t &hash_verified, verified_t &sig_verified, get_more_bin_cb more_cb) {
+    verify_block_data(get_verify_data(bin, storage_addr, runtime_addr, block, more_cb), block, hash_verified, sig_verified);
+}
+
+
 void encrypt_guts(elf_file *elf, block *new_block, const aes_key_t aes_key, std::vector<uint8_t> &iv_data, std::vector<uint8_t> &enc_data) {
     std::vector<uint8_t> to_enc = get_lm_hash_data(elf, new_block);
 
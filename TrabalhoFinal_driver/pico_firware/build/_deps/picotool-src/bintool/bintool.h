@@ -35,9 +35,16 @@ std::unique_ptr<block> find_first_block(std::vector<uint8_t> bin, uint32_t stora
 std::unique_ptr<block> get_last_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::unique_ptr<block> &first_block, get_more_bin_cb more_cb = nullptr);
 std::vector<std::unique_ptr<block>> get_all_blocks(std::vector<uint8_t> &bin, uint32_t storage_addr, std::unique_ptr<block> &first_block, get_more_bin_cb more_cb = nullptr);
 block place_new_block(std::vector<uint8_t> &bin, uint32_t storage_addr, std::unique_ptr<block> &first_block, bool set_others_ignored=false);
-uint32_t calc_checksum(std::vector<uint8_t> bin);
+// For a bin that is only available through more_cb - rather than changing the bin, this returns the offset (from
+// storage_addr) of the word that needs to be set to patch_value, to add the new block to the block loop
+block place_new_block(uint32_t storage_addr, uint32_t bin_size, std::unique_ptr<block> &first_block, get_more_bin_cb more_cb, uint32_t &patch_offset, uint32_t &patch_value);
+uint32_t calc_checksum(const std::vector<uint8_t> &bin);
 #if HAS_MBEDTLS
     std::vector<uint8_t> hash_andor_sign(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *new_block, const public_t public_key, const private_t private_key, bool hash_value, bool sign, bool clear_sram = false);
     std::vector<uint8_t> encrypt(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *new_block, const aes_key_t aes_key, const public_t public_key, const private_t private_key, std::vector<uint8_t> iv_salt, bool hash_value, bool sign);
     void verify_block(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *block, verified_t &hash_verified, verified_t &sig_verified, get_more_bin_cb more_cb = nullptr);
+    // verify_block in two steps: get_verify_data does any reads (via more_cb) and gathers the data to hash, then
+    // verify_block_data does the hash/signature checks without touching anything but its arguments
+    std::vector<uint8_t> get_verify_data(std::vector<uint8_t> bin, uint32_t storage_addr, uint32_t runtime_addr, block *block, get_more_bin_cb more_cb = nullptr);
+    void verify_block_data(const std::vector<uint8_t> &to_hash, block *block, verified_t &hash_verified, verified_t &sig_verified);
 #endif
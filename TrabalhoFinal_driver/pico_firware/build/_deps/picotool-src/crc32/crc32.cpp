@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "crc32.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32_HAS_PCLMUL 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CRC32_TARGET_PCLMUL
+#else
+#include <cpuid.h>
+#define CRC32_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#endif
+#elif defined(__aarch64__) && defined(__GNUC__)
+#define CRC32_HAS_ARM_CRC 1
+#if !defined(__ARM_FEATURE_CRC32) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1u << 7)
+#endif
+#endif
+#define CRC32_TARGET_ARM_CRC __attribute__((target("+crc")))
+#endif
+
+namespace {
+    const uint32_t POLYNOMIAL = 0x04C11DB7;
+    const uint32_t POLYNOMIAL_REFLECTED = 0xEDB88320;
+
+    // Table k advances the CRC by one byte followed by k zero bytes
+    struct crc_tables {
+        uint32_t msb[8][256];
+        uint32_t reflected[8][256];
+
+        crc_tables() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t m = i << 24;
+                uint32_t r = i;
+                for (int bit = 0; bit < 8; bit++) {
+                    m = (m & 0x80000000u) ? (m << 1) ^ POLYNOMIAL : m << 1;
+                    r = (r & 1) ? (r >> 1) ^ POLYNOMIAL_REFLECTED : r >> 1;
+                }
+                msb[0][i] = m;
+                reflected[0][i] = r;
+            }
+            for (int k = 1; k < 8; k++) {
+                for (uint32_t i = 0; i < 256; i++) {
+                    msb[k][i] = (msb[k - 1][i] << 8) ^ msb[0][msb[k - 1][i] >> 24];
+                    reflected[k][i] = (reflected[k - 1][i] >> 8) ^ reflected[0][reflected[k - 1][i] & 0xff];
+                }
+            }
+        }
+    };
+
+    const crc_tables &tables() {
+        static const crc_tables t;
+        return t;
+    }
+
+    uint32_t load_be32(const uint8_t *p) {
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    uint32_t load_le32(const uint8_t *p) {
+        return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+    }
+
+    uint32_t msb_bytewise(uint32_t crc, const uint8_t *p, size_t len) {
+        auto &t = tables().msb[0];
+        while (len--) crc = (crc << 8) ^ t[(crc >> 24) ^ *p++];
+        return crc;
+    }
+
+    uint32_t reflected_bytewise(uint32_t crc, const uint8_t *p, size_t len) {
+        auto &t = tables().reflected[0];
+        while (len--) crc = (crc >> 8) ^ t[(crc ^ *p++) & 0xff];
+        return crc;
+    }
+
+    uint32_t msb_slice8(uint32_t crc, const uint8_t *p, size_t len) {
+        auto &t = tables().msb;
+        for (; len >= 8; p += 8, len -= 8) {
+            uint32_t a = crc ^ load_be32(p);
+            uint32_t b = load_be32(p + 4);
+            crc = t[7][a >> 24] ^ t[6][(a >> 16) & 0xff] ^ t[5][(a >> 8) & 0xff] ^ t[4][a & 0xff] ^
+                  t[3][b >> 24] ^ t[2][(b >> 16) & 0xff] ^ t[1][(b >> 8) & 0xff] ^ t[0][b & 0xff];
+        }
+        return msb_bytewise(crc, p, len);
+    }
+
+    uint32_t reflected_slice8(uint32_t crc, const uint8_t *p, size_t len) {
+        auto &t = tables().reflected;
+        for (; len >= 8; p += 8, len -= 8) {
+            uint32_t a = crc ^ load_le32(p);
+            uint32_t b = load_le32(p + 4);
+            crc = t[7][a & 0xff] ^ t[6][(a >> 8) & 0xff] ^ t[5][(a >> 16) & 0xff] ^ t[4][a >> 24] ^
+                  t[3][b & 0xff] ^ t[2][(b >> 8) & 0xff] ^ t[1][(b >> 16) & 0xff] ^ t[0][b >> 24];
+        }
+        return reflected_bytewise(crc, p, len);
+    }
+
+#if CRC32_HAS_PCLMUL
+    // Carry-less multiply folding, 64 bytes per iteration. The folded 128-bit remainder is finished off with
+    // the table code, which avoids needing a Barrett reduction.
+
+    // reflected fold constants: (x^(64*n+32) mod P, x^(64*n-32) mod P) reflected, for 512 and 128 bit folds
+    const uint64_t REFLECTED_K1 = 0x154442bd4, REFLECTED_K2 = 0x1c6e41596;
+    const uint64_t REFLECTED_K3 = 0x1751997d0, REFLECTED_K4 = 0x0ccaa009e;
+
+    // msb fold constants: x^(d+64) mod P and x^d mod P, for d = 512 and 128
+    const uint64_t MSB_K512_HI = 0x8833794c, MSB_K512_LO = 0xe6228b11;
+    const uint64_t MSB_K128_HI = 0xc5b9cd4c, MSB_K128_LO = 0xe8a45605;
+
+    CRC32_TARGET_PCLMUL inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+        return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00), _mm_clmulepi64_si128(x, k, 0x11)), next);
+    }
+
+    CRC32_TARGET_PCLMUL uint32_t reflected_pclmul(uint32_t crc, const uint8_t *p, size_t len) {
+        if (len < 64) return reflected_slice8(crc, p, len);
+        __m128i x0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), _mm_cvtsi32_si128((int)crc));
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 48));
+        p += 64; len -= 64;
+        __m128i k = _mm_set_epi64x(REFLECTED_K2, REFLECTED_K1);
+        for (; len >= 64; p += 64, len -= 64) {
+            x0 = fold(x0, k, _mm_loadu_si128((const __m128i *)p));
+            x1 = fold(x1, k, _mm_loadu_si128((const __m128i *)(p + 16)));
+            x2 = fold(x2, k, _mm_loadu_si128((const __m128i *)(p + 32)));
+            x3 = fold(x3, k, _mm_loadu_si128((const __m128i *)(p + 48)));
+        }
+        k = _mm_set_epi64x(REFLECTED_K4, REFLECTED_K3);
+        x1 = fold(x0, k, x1);
+        x2 = fold(x1, k, x2);
+        x3 = fold(x2, k, x3);
+        for (; len >= 16; p += 16, len -= 16) {
+            x3 = fold(x3, k, _mm_loadu_si128((const __m128i *)p));
+        }
+        uint8_t rem[16];
+        _mm_storeu_si128((__m128i *)rem, x3);
+        return reflected_slice8(reflected_slice8(0, rem, sizeof(rem)), p, len);
+    }
+
+    CRC32_TARGET_PCLMUL uint32_t msb_pclmul(uint32_t crc, const uint8_t *p, size_t len) {
+        if (len < 64) return msb_slice8(crc, p, len);
+        // byte reverse each block, so that lane 1 holds the first (highest order) 8 bytes
+        const __m128i swap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+#define LOAD_BE128(ptr) _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(ptr)), swap)
+        __m128i x0 = _mm_xor_si128(LOAD_BE128(p), _mm_set_epi32((int)crc, 0, 0, 0));
+        __m128i x1 = LOAD_BE128(p + 16);
+        __m128i x2 = LOAD_BE128(p + 32);
+        __m128i x3 = LOAD_BE128(p + 48);
+        p += 64; len -= 64;
+        __m128i k = _mm_set_epi64x(MSB_K512_HI, MSB_K512_LO);
+        for (; len >= 64; p += 64, len -= 64) {
+            x0 = fold(x0, k, LOAD_BE128(p));
+            x1 = fold(x1, k, LOAD_BE128(p + 16));
+            x2 = fold(x2, k, LOAD_BE128(p + 32));
+            x3 = fold(x3, k, LOAD_BE128(p + 48));
+        }
+        k = _mm_set_epi64x(MSB_K128_HI, MSB_K128_LO);
+        x1 = fold(x0, k, x1);
+        x2 = fold(x1, k, x2);
+        x3 = fold(x2, k, x3);
+        for (; len >= 16; p += 16, len -= 16) {
+            x3 = fold(x3, k, LOAD_BE128(p));
+        }
+#undef LOAD_BE128
+        uint8_t rem[16];
+        _mm_storeu_si128((__m128i *)rem, _mm_shuffle_epi8(x3, swap));
+        return msb_slice8(msb_slice8(0, rem, sizeof(rem)), p, len);
+    }
+
+    bool cpu_has_pclmul() {
+        unsigned int ecx;
+#if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 1);
+        ecx = (unsigned int)info[2];
+#else
+        unsigned int eax, ebx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+#endif
+        // PCLMULQDQ, SSSE3 and SSE4.1
+        return (ecx & (1u << 1)) && (ecx & (1u << 9)) && (ecx & (1u << 19));
+    }
+#endif
+
+#if CRC32_HAS_ARM_CRC
+    // The AArch64 CRC32 instructions implement the reflected CRC; the MSB-first CRC is the same
+    // calculation on bit-reversed data and register
+    CRC32_TARGET_ARM_CRC inline uint32_t arm_crc32x(uint32_t crc, uint64_t v) {
+        uint32_t out;
+        __asm__("crc32x %w0, %w1, %x2" : "=r"(out) : "r"(crc), "r"(v));
+        return out;
+    }
+
+    CRC32_TARGET_ARM_CRC inline uint32_t arm_crc32b(uint32_t crc, uint8_t v) {
+        uint32_t out;
+        __asm__("crc32b %w0, %w1, %w2" : "=r"(out) : "r"(crc), "r"((uint32_t)v));
+        return out;
+    }
+
+    inline uint64_t rbit64(uint64_t v) {
+        uint64_t out;
+        __asm__("rbit %x0, %x1" : "=r"(out) : "r"(v));
+        return out;
+    }
+
+    inline uint32_t rbit32(uint32_t v) {
+        uint32_t out;
+        __asm__("rbit %w0, %w1" : "=r"(out) : "r"(v));
+        return out;
+    }
+
+    inline uint64_t load_le64(const uint8_t *p) {
+        return (uint64_t)load_le32(p) | ((uint64_t)load_le32(p + 4) << 32);
+    }
+
+    CRC32_TARGET_ARM_CRC uint32_t reflected_arm(uint32_t crc, const uint8_t *p, size_t len) {
+        for (; len >= 8; p += 8, len -= 8) crc = arm_crc32x(crc, load_le64(p));
+        while (len--) crc = arm_crc32b(crc, *p++);
+        return crc;
+    }
+
+    CRC32_TARGET_ARM_CRC uint32_t msb_arm(uint32_t crc, const uint8_t *p, size_t len) {
+        crc = rbit32(crc);
+        // rbit of the byte swapped word reverses the bits within each byte, leaving the bytes in place
+        for (; len >= 8; p += 8, len -= 8) crc = arm_crc32x(crc, rbit64(__builtin_bswap64(load_le64(p))));
+        while (len--) crc = arm_crc32b(crc, (uint8_t)(rbit32(*p++) >> 24));
+        return rbit32(crc);
+    }
+
+    bool cpu_has_arm_crc() {
+#if defined(__ARM_FEATURE_CRC32)
+        return true;
+#elif defined(__linux__)
+        return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+        return false;
+#endif
+    }
+#endif
+
+    typedef uint32_t (*crc_fn)(uint32_t crc, const uint8_t *p, size_t len);
+
+    struct crc_kernel {
+        crc_fn msb;
+        crc_fn reflected;
+        const char *name;
+    };
+
+    crc_kernel select_kernel() {
+#if CRC32_HAS_PCLMUL
+        if (cpu_has_pclmul()) return {msb_pclmul, reflected_pclmul, "pclmul"};
+#endif
+#if CRC32_HAS_ARM_CRC
+        if (cpu_has_arm_crc()) return {msb_arm, reflected_arm, "armv8-crc"};
+#endif
+        return {msb_slice8, reflected_slice8, "slice-by-8"};
+    }
+
+    const crc_kernel &kernel() {
+        static const crc_kernel k = select_kernel();
+        return k;
+    }
+}
+
+uint32_t crc32_msb_update(uint32_t crc, const void *data, size_t len) {
+    return kernel().msb(crc, (const uint8_t *)data, len);
+}
+
+uint32_t crc32_reflected_update(uint32_t crc, const void *data, size_t len) {
+    return kernel().reflected(crc, (const uint8_t *)data, len);
+}
+
+uint32_t crc32_msb_update_bytewise(uint32_t crc, const void *data, size_t len) {
+    return msb_bytewise(crc, (const uint8_t *)data, len);
+}
+
+uint32_t crc32_reflected_update_bytewise(uint32_t crc, const void *data, size_t len) {
+    return reflected_bytewise(crc, (const uint8_t *)data, len);
+}
+
+const char *crc32_kernel_name(void) {
+    return kernel().name;
+}
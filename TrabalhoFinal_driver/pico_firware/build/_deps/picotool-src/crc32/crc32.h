@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// All functions use the 0x04C11DB7 polynomial, and take/return the raw CRC register - any initial value
+// and final XOR are up to the caller, so a buffer can be processed in several calls.
+//
+// The fastest kernel supported by the host CPU (PCLMULQDQ on x86, the CRC32 instructions on AArch64, or
+// slice-by-8 tables otherwise) is selected on first use.
+
+// MSB-first (non-reflected) CRC, as used by the bootrom for the boot2 checksum and by the PICOBOOT protocol
+uint32_t crc32_msb_update(uint32_t crc, const void *data, size_t len);
+
+// Reflected (LSB-first) CRC, i.e. the zlib/IEEE 802.3 CRC-32 register
+uint32_t crc32_reflected_update(uint32_t crc, const void *data, size_t len);
+
+// Reference byte-at-a-time implementations, for checking/benchmarking the accelerated kernels
+uint32_t crc32_msb_update_bytewise(uint32_t crc, const void *data, size_t len);
+uint32_t crc32_reflected_update_bytewise(uint32_t crc, const void *data, size_t len);
+
+// Name of the selected kernel, e.g. "pclmul"
+const char *crc32_kernel_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
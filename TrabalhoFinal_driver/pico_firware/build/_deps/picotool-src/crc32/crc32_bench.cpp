@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Compares the throughput of the selected CRC kernel with the byte-at-a-time implementations that picoboot and
+// bintool used before, and checks that they agree. Built with the crc32_bench target, which is not part of 'all'
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "crc32.h"
+
+typedef uint32_t (*crc_fn)(uint32_t crc, const void *data, size_t len);
+
+static double megabytes_per_second(crc_fn fn, const std::vector<uint8_t> &data, int iterations, uint32_t &result) {
+    auto start = std::chrono::steady_clock::now();
+    uint32_t crc = 0xffffffff;
+    for (int i = 0; i < iterations; i++) {
+        crc = fn(crc, data.data(), data.size());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result = crc;
+    return (double)data.size() * iterations / elapsed.count() / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+    size_t size = argc > 1 ? strtoul(argv[1], nullptr, 0) : 0x100000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 64;
+    std::vector<uint8_t> data(size);
+    uint32_t x = 1;
+    for (auto &b : data) {
+        x = x * 1664525 + 1013904223;
+        b = x >> 24;
+    }
+
+    struct {
+        const char *name;
+        crc_fn fast;
+        crc_fn bytewise;
+    } polys[] = {
+        {"MSB-first", crc32_msb_update, crc32_msb_update_bytewise},
+        {"reflected", crc32_reflected_update, crc32_reflected_update_bytewise},
+    };
+    printf("kernel: %s, %zu bytes x %d\n", crc32_kernel_name(), size, iterations);
+    int rc = 0;
+    for (auto &p : polys) {
+        uint32_t fast_crc, bytewise_crc;
+        double fast = megabytes_per_second(p.fast, data, iterations, fast_crc);
+        double bytewise = megabytes_per_second(p.bytewise, data, iterations, bytewise_crc);
+        printf("%-10s %9.1f MB/s  bytewise %8.1f MB/s  (%.1fx)%s\n", p.name, fast, bytewise, fast / bytewise,
+               fast_crc == bytewise_crc ? "" : "  MISMATCH");
+        if (fast_crc != bytewise_crc) rc = 1;
+    }
+    return rc;
+}
@@ -6,8 +6,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdio>
 #include <cstdarg>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <iostream>
@@ -23,6 +25,16 @@
 
 #include "portable_endian.h"
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
 // tsk namespace is polluted on windows
 #ifdef _WIN32
 #undef min
@@ -201,33 +213,74 @@ int elf_file::read_header(void) {
     return rp_check_elf_header(eh);
 }
 
+#define SH_DATA_MODIFIED 0xffffffffu
+
+// Copies src into elf_bytes, recording the range as dirty if anything changed
+void elf_file::patch_bytes(uint32_t offset, const void *src, uint32_t length) {
+    if (!length || !memcmp(&elf_bytes[offset], src, length)) return;
+    memcpy(&elf_bytes[offset], src, length);
+    dirty_ranges.emplace_back(offset, offset + length);
+}
+
 // Flattens the data in the section array the elf_bytes blob
+//
+// Anything not covered by the headers or a section is zeroed. Sections whose data is already in place in
+// elf_bytes are not copied, so after small modifications only the changed bytes are touched.
 void elf_file::flatten(void) {
-    elf_bytes.resize(sizeof(eh));
+    std::vector<std::pair<uint32_t, uint32_t>> covered;
+    covered.emplace_back(0, sizeof(eh));
+    covered.emplace_back(eh.ph_offset, eh.ph_offset + sizeof(elf32_ph_entry) * eh.ph_num);
+    covered.emplace_back(eh.sh_offset, eh.sh_offset + sizeof(elf32_sh_entry) * eh.sh_num);
+    for (const auto &sh : sh_entries) {
+        if (sh.size && sh.type != SHT_NOBITS) {
+            covered.emplace_back(sh.offset, sh.offset + sh.size);
+        }
+    }
+    std::sort(covered.begin(), covered.end());
+
+    uint32_t new_size = 0;
+    for (const auto &c : covered) new_size = std::max(new_size, c.second);
+    if (new_size > elf_bytes.size()) {
+        dirty_ranges.emplace_back(elf_bytes.size(), new_size);
+    }
+    elf_bytes.resize(new_size);
+
+    // Zero any gaps
+    uint32_t pos = 0;
+    for (const auto &c : covered) {
+        if (c.first > pos && std::any_of(elf_bytes.begin() + pos, elf_bytes.begin() + c.first, [](uint8_t b) { return b != 0; })) {
+            std::fill(elf_bytes.begin() + pos, elf_bytes.begin() + c.first, 0);
+            dirty_ranges.emplace_back(pos, c.first);
+        }
+        pos = std::max(pos, c.second);
+    }
+
     auto eh_out = eh;
     eh_le(eh_out);    // swap to LE for writing
-    memcpy(&elf_bytes[0], &eh_out, sizeof(eh_out));
+    patch_bytes(0, &eh_out, sizeof(eh_out));
 
-    elf_bytes.resize(std::max(eh.ph_offset + sizeof(elf32_ph_entry) * eh.ph_num, elf_bytes.size()));
-    auto ph_entries_out = ph_entries;
-    for (auto ph : ph_entries_out) {
-        ph_le(ph);  // swap to LE for writing
+    if (eh.ph_num) {
+        auto ph_entries_out = ph_entries;
+        for (auto ph : ph_entries_out) {
+            ph_le(ph);  // swap to LE for writing
+        }
+        patch_bytes(eh.ph_offset, &ph_entries_out[0], sizeof(elf32_ph_entry) * eh.ph_num);
     }
-    memcpy(&elf_bytes[eh.ph_offset], &ph_entries_out[0], sizeof(elf32_ph_entry) * eh.ph_num);
 
-    elf_bytes.resize(std::max(eh.sh_offset + sizeof(elf32_sh_entry) * eh.sh_num, elf_bytes.size()));
-    auto sh_entries_out = sh_entries;
-    for (auto sh : sh_entries_out) {
-        sh_le(sh);  // swap to LE for writing
+    if (eh.sh_num) {
+        auto sh_entries_out = sh_entries;
+        for (auto sh : sh_entries_out) {
+            sh_le(sh);  // swap to LE for writing
+        }
+        patch_bytes(eh.sh_offset, &sh_entries_out[0], sizeof(elf32_sh_entry) * eh.sh_num);
     }
-    memcpy(&elf_bytes[eh.sh_offset], &sh_entries_out[0], sizeof(elf32_sh_entry) * eh.sh_num);
 
     int idx = 0;
     for (const auto &sh : sh_entries) {
-        if (sh.size && sh.type != SHT_NOBITS) {
-            elf_bytes.resize(std::max(sh.offset + sh.size, (uint32_t)elf_bytes.size()));
-            memcpy(&elf_bytes[sh.offset], &sh_data[idx][0], sh.size);
+        if (sh.size && sh.type != SHT_NOBITS && sh_data_offset[idx] != sh.offset) {
+            patch_bytes(sh.offset, &sh_data[idx][0], sh.size);
         }
+        sh_data_offset[idx] = sh.offset;
         idx++;
     }
     if (verbose) printf("Elf file size %zu\n", elf_bytes.size());
@@ -240,6 +293,115 @@ void elf_file::write(std::shared_ptr<std::iostream> out) {
     out->write(reinterpret_cast<const char*>(&elf_bytes[0]), elf_bytes.size());
 }
 
+void elf_file::write_bytes(std::ostream &out, uint32_t offset, uint32_t length) {
+    out.seekp(offset);
+    out.write(reinterpret_cast<const char*>(&elf_bytes[offset]), length);
+}
+
+bool is_same_file(const std::string &a, const std::string &b) {
+#ifdef _WIN32
+    char full_a[_MAX_PATH], full_b[_MAX_PATH];
+    if (!_fullpath(full_a, a.c_str(), sizeof(full_a)) || !_fullpath(full_b, b.c_str(), sizeof(full_b))) return a == b;
+    return !_stricmp(full_a, full_b);
+#else
+    struct stat sa, sb;
+    if (stat(a.c_str(), &sa) || stat(b.c_str(), &sb)) return false;
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+#endif
+}
+
+// Copy the first length bytes of source to a new file dest, using reflinks or in-kernel copies where available
+static void copy_file_prefix(const std::string &source, const std::string &dest, uint64_t length, bool whole_file) {
+    uint64_t done = 0;
+#ifdef __linux__
+    int in_fd = open(source.c_str(), O_RDONLY);
+    if (in_fd < 0) fail(ERROR_READ_FAILED, "Could not open '%s'", source.c_str());
+    int out_fd = open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out_fd < 0) {
+        close(in_fd);
+        fail(ERROR_WRITE_FAILED, "Could not open '%s'", dest.c_str());
+    }
+#ifdef FICLONE
+    if (whole_file && !ioctl(out_fd, FICLONE, in_fd)) done = length;
+#endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    while (done < length) {
+        ssize_t n = copy_file_range(in_fd, nullptr, out_fd, nullptr, length - done, 0);
+        if (n <= 0) break; // not supported for these files, so fall back to copying below
+        done += n;
+    }
+#endif
+    std::vector<char> buf(1u << 20);
+    while (done < length) {
+        ssize_t n = pread(in_fd, buf.data(), std::min<uint64_t>(buf.size(), length - done), done);
+        if (n <= 0 || pwrite(out_fd, buf.data(), n, done) != n) {
+            close(in_fd);
+            close(out_fd);
+            fail(ERROR_WRITE_FAILED, "Failed to copy '%s' to '%s'", source.c_str(), dest.c_str());
+        }
+        done += n;
+    }
+    close(in_fd);
+    if (close(out_fd)) fail(ERROR_WRITE_FAILED, "Failed to write '%s'", dest.c_str());
+#else
+    std::ifstream in(source, std::ios::in | std::ios::binary);
+    std::ofstream out(dest, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (in.fail()) fail(ERROR_READ_FAILED, "Could not open '%s'", source.c_str());
+    if (out.fail()) fail(ERROR_WRITE_FAILED, "Could not open '%s'", dest.c_str());
+    std::vector<char> buf(1u << 20);
+    while (done < length) {
+        size_t n = std::min<uint64_t>(buf.size(), length - done);
+        if (!in.read(buf.data(), n) || !out.write(buf.data(), n)) {
+            fail(ERROR_WRITE_FAILED, "Failed to copy '%s' to '%s'", source.c_str(), dest.c_str());
+        }
+        done += n;
+    }
+#endif
+}
+
+void elf_file::write_incremental(const std::string &filename, const std::string &source_filename) {
+    flatten();
+
+    // Coalesce the dirty ranges
+    std::sort(dirty_ranges.begin(), dirty_ranges.end());
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    uint64_t dirty_size = 0;
+    for (auto r : dirty_ranges) {
+        r.second = std::min(r.second, (uint32_t)elf_bytes.size());
+        if (r.first >= r.second) continue;
+        if (!ranges.empty() && r.first <= ranges.back().second) {
+            ranges.back().second = std::max(ranges.back().second, r.second);
+        } else {
+            ranges.push_back(r);
+        }
+    }
+    for (const auto &r : ranges) dirty_size += r.second - r.first;
+
+    bool same_file = is_same_file(filename, source_filename);
+    if (elf_bytes.size() < source_size ? same_file : (!same_file && dirty_size * 2 > elf_bytes.size())) {
+        // Needs truncating in place, or mostly rewritten anyway
+        auto out = std::make_shared<std::fstream>(filename, std::ios::out | std::ios::binary);
+        if (out->fail()) fail(ERROR_WRITE_FAILED, "Could not open '%s'", filename.c_str());
+        write(out);
+        return;
+    }
+
+    if (!same_file) {
+        uint32_t copy_size = std::min(source_size, (uint32_t)elf_bytes.size());
+        copy_file_prefix(source_filename, filename, copy_size, copy_size == source_size);
+    }
+    std::fstream out(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (out.fail()) fail(ERROR_WRITE_FAILED, "Could not open '%s'", filename.c_str());
+    out.exceptions(std::iostream::failbit | std::iostream::badbit);
+    if (verbose) printf("Patching %zu ranges (%" PRIu64 " bytes) of %zu byte file\n", ranges.size(), dirty_size, elf_bytes.size());
+    for (const auto &r : ranges) {
+        write_bytes(out, r.first, r.second - r.first);
+    }
+    out.close();
+    source_size = elf_bytes.size();
+    dirty_ranges.clear();
+}
+
 void elf_file::read_sh(void) {
     if (verbose) printf("%s sh offset %u #entries %d\n", __func__, eh.sh_offset, eh.sh_num);
     if (eh.sh_num) {
@@ -329,11 +491,26 @@ void elf_file::remove_empty_ph_entries(void) {
 void elf_file::read_sh_data(void) {
     int sh_idx = 0;
     sh_data.resize(eh.sh_num);
+    sh_data_offset.resize(eh.sh_num);
     for (const auto &sh: sh_entries) {
         if (sh.size && sh.type != SHT_NOBITS) {
             sh_data[sh_idx].resize(sh.size);
             read_bytes(sh.offset, sh.size, &sh_data[sh_idx][0]);
         }
+        sh_data_offset[sh_idx] = sh.offset;
+        sh_idx++;
+    }
+}
+
+// Refresh the section data overlapping a modified range of the internal byte array
+void elf_file::update_sh_data(uint32_t offset, uint32_t length) {
+    int sh_idx = 0;
+    for (const auto &sh: sh_entries) {
+        if (sh.size && sh.type != SHT_NOBITS && sh.offset < offset + length && offset < sh.offset + sh.size) {
+            uint32_t from = std::max(offset, sh.offset);
+            uint32_t to = std::min(offset + length, sh.offset + sh.size);
+            memcpy(&sh_data[sh_idx][from - sh.offset], &elf_bytes[from], to - from);
+        }
         sh_idx++;
     }
 }
@@ -390,6 +567,7 @@ uint32_t elf_file::append_section_name(const std::string &sh_name_str) {
     sh_entries[eh.sh_str_index].size += name_bytes.size();
     uint32_t sh_name = shstrtab_data.size();
     shstrtab_data.insert(shstrtab_data.end(), name_bytes.begin(), name_bytes.end());
+    sh_data_offset[eh.sh_str_index] = SH_DATA_MODIFIED;
 
     // Move offsets for anything stored after the resized section header table
     for (auto &sh: sh_entries) {
@@ -441,6 +619,8 @@ int elf_file::read_file(std::shared_ptr<std::iostream> file) {
     int rc = 0;
     try {
         elf_bytes = read_binfile(file);
+        source_size = elf_bytes.size();
+        dirty_ranges.clear();
         int rc = read_header();
         if (!rc) {
             read_ph();
@@ -491,16 +671,18 @@ void elf_file::content(const elf32_ph_entry &ph, const std::vector<uint8_t> &con
     if (!editable) return;
     assert(content.size() <= ph.filez);
     if (verbose) printf("Update segment content offset %x content size %zx physical size %x\n", ph.offset, content.size(), ph.filez);
-    memcpy(&elf_bytes[ph.offset], &content[0], std::min(content.size(), (size_t) ph.filez));
-    read_sh_data(); // Extract the sections after modifying the content
+    uint32_t size = std::min(content.size(), (size_t) ph.filez);
+    patch_bytes(ph.offset, &content[0], size);
+    update_sh_data(ph.offset, size); // Update the sections after modifying the content
 }
 
 void elf_file::content(const elf32_sh_entry &sh, const std::vector<uint8_t> &content) {
     if (!editable) return;
     assert(content.size() <= sh.size);
     if (verbose) printf("Update section content offset %x content size %zx section size %x\n", sh.offset, content.size(), sh.size);
-    memcpy(&elf_bytes[sh.offset], &content[0], std::min(content.size(), (size_t) sh.size));
-    read_sh_data();  // Extract the sections after modifying the content
+    uint32_t size = std::min(content.size(), (size_t) sh.size);
+    patch_bytes(sh.offset, &content[0], size);
+    update_sh_data(sh.offset, size);  // Update the sections after modifying the content
 }
 
 const elf32_ph_entry* elf_file::segment_from_physical_address(uint32_t paddr) {
@@ -537,7 +719,6 @@ const elf32_ph_entry* elf_file::segment_from_section(const elf32_sh_entry &sh) {
 // Use content to replace the content
 const elf32_ph_entry& elf_file::append_segment(uint32_t vaddr, uint32_t paddr, uint32_t size, const std::string &name) {
     elf32_ph_entry ph;
-    read_sh_data(); // Convert the section data back into discreet chunks
     uint32_t sh_name = append_section_name(name);
 
     ph.type = PT_LOAD;
@@ -587,6 +768,7 @@ const elf32_ph_entry& elf_file::append_segment(uint32_t vaddr, uint32_t paddr, u
     // Add the new segment for the signature and point to offset in file for data
     sh_entries.push_back(sh);
     sh_data.push_back(std::vector<uint8_t>(size));
+    sh_data_offset.push_back(SH_DATA_MODIFIED);
     ph_entries.back().offset = sh.offset;
 
     eh.sh_offset = sh.offset + sh.size;
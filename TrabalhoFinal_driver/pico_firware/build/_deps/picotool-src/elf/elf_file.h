@@ -14,6 +14,7 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
 #include "elf.h"
 
@@ -24,6 +25,9 @@ public:
     elf_file(bool verbose = false) : verbose(verbose) {};
     int read_file(std::shared_ptr<std::iostream> file);
     void write(std::shared_ptr<std::iostream> file);
+    // Write to filename, copying the unchanged parts of source_filename (the file passed to read_file) and
+    // only writing the byte ranges that have been modified
+    void write_incremental(const std::string &filename, const std::string &source_filename);
 
     const elf32_ph_entry& append_segment(uint32_t vaddr, uint32_t paddr, uint32_t size, const std::string &section_name);
 
@@ -62,6 +66,9 @@ private:
     void read_bytes(unsigned offset, unsigned length, void *dest);
     uint32_t append_section_name(const std::string &sh_name_str);
     void flatten(void);
+    void patch_bytes(uint32_t offset, const void *src, uint32_t length);
+    void update_sh_data(uint32_t offset, uint32_t length);
+    void write_bytes(std::ostream &out, uint32_t offset, uint32_t length);
 
 private:
     elf32_header eh;
@@ -69,8 +76,15 @@ private:
     std::vector<elf32_ph_entry> ph_entries;
     std::vector<elf32_sh_entry> sh_entries;
     std::vector<std::vector<uint8_t>> sh_data;
+    // Offset in elf_bytes that each sh_data entry matches, or SH_DATA_MODIFIED if it has been changed since
+    std::vector<uint32_t> sh_data_offset;
+    // Ranges of elf_bytes which differ from the file passed to read_file
+    std::vector<std::pair<uint32_t, uint32_t>> dirty_ranges;
+    uint32_t source_size = 0;
     bool verbose;
 };
 int rp_check_elf_header(const elf32_header &eh);
 int rp_determine_binary_type(const elf32_header &eh, const std::vector<elf32_ph_entry>& entries, address_ranges flash_range, address_ranges ram_range, bool *ram_style);
+// Whether paths a and b name the same existing file. Windows has no inode numbers, so there the full paths are compared
+bool is_same_file(const std::string &a, const std::string &b);
 #endif
\ No newline at end of file
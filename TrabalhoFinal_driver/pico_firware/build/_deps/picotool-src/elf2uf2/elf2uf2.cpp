@@ -235,6 +235,164 @@ int bin2uf2(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> ou
     return pages2uf2(pages, in, out, family_id, abs_block_loc);
 }
 
+uf2_stream_writer::uf2_stream_writer(std::shared_ptr<std::iostream> out, uint32_t address, uint32_t size, uint32_t family_id) : out(out) {
+    if (address & (UF2_PAGE_SIZE - 1)) {
+        fail(ERROR_INCOMPATIBLE, "UF2 start address %08x is not page aligned", address);
+    }
+    block.magic_start0 = UF2_MAGIC_START0;
+    block.magic_start1 = UF2_MAGIC_START1;
+    block.flags = UF2_FLAG_FAMILY_ID_PRESENT;
+    block.payload_size = UF2_PAGE_SIZE;
+    block.num_blocks = (size + UF2_PAGE_SIZE - 1) / UF2_PAGE_SIZE;
+    block.file_size = family_id;
+    block.magic_end = UF2_MAGIC_END;
+    block.target_addr = address;
+    block.block_no = 0;
+    memset(block.data, 0, sizeof(block.data));
+}
+
+void uf2_stream_writer::write(const uint8_t *data, size_t len) {
+    while (len) {
+        size_t this_len = std::min((size_t)(UF2_PAGE_SIZE - page_fill), len);
+        memcpy(block.data + page_fill, data, this_len);
+        page_fill += this_len;
+        data += this_len;
+        len -= this_len;
+        if (page_fill == UF2_PAGE_SIZE) flush_page();
+    }
+}
+
+void uf2_stream_writer::finish() {
+    if (page_fill) flush_page();
+    if (block.block_no != block.num_blocks) {
+        fail(ERROR_UNKNOWN, "Wrote %d UF2 blocks, but expected %d", block.block_no, block.num_blocks);
+    }
+}
+
+void uf2_stream_writer::flush_page() {
+    if (block.block_no >= block.num_blocks) {
+        fail(ERROR_UNKNOWN, "Too much data for UF2 of %d blocks", block.num_blocks);
+    }
+    out->write((char*)&block, sizeof(uf2_block));
+    if (out->fail()) {
+        fail_write_error();
+    }
+    block.target_addr += UF2_PAGE_SIZE;
+    block.block_no++;
+    page_fill = 0;
+    memset(block.data, 0, sizeof(block.data));
+}
+
+static bool is_family_page(const uf2_block &block, uint32_t family_id) {
+    // Same blocks as picotool reads for a family - see build_rmap_uf2
+    return block.magic_start0 == UF2_MAGIC_START0 && block.magic_start1 == UF2_MAGIC_START1 &&
+        block.magic_end == UF2_MAGIC_END && (block.flags & UF2_FLAG_FAMILY_ID_PRESENT) &&
+        !(block.flags & UF2_FLAG_NOT_MAIN_FLASH) && block.payload_size == UF2_PAGE_SIZE &&
+        block.file_size == family_id && !check_abs_block(block);
+}
+
+int uf2_patch_family(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> out, uint32_t family_id, uint32_t address, const std::vector<uint8_t> &image, uint32_t abs_block_loc, bool verbose) {
+    g_verbose = verbose;
+    uf2_block block;
+    auto read_block = [&]() {
+        in->read((char*)&block, sizeof(uf2_block));
+        if (in->fail()) {
+            if (in->eof()) { in->clear(); return false; }
+            fail_read_error();
+        }
+        return true;
+    };
+    auto write_block = [&]() {
+        out->write((char*)&block, sizeof(uf2_block));
+        if (out->fail()) {
+            fail_write_error();
+        }
+    };
+
+    // First pass over the headers, to find which pages the family already has, and where its last block is
+    std::set<uint32_t> present;
+    unsigned int last_index = 0;
+    unsigned int family_blocks = 0;
+    uint32_t next_block_no = 0;
+    uint32_t num_blocks = 0;
+    bool has_abs_block = false;
+    in->clear();
+    in->seekg(0, in->beg);
+    for (unsigned int index = 0; read_block(); index++) {
+        if (check_abs_block(block)) {
+            has_abs_block = true;
+        } else if (is_family_page(block, family_id)) {
+            present.insert(block.target_addr);
+            last_index = index;
+            family_blocks++;
+            next_block_no = block.block_no + 1;
+            num_blocks = block.num_blocks;
+        }
+    }
+    if (!family_blocks) {
+        fail(ERROR_FORMAT, "The input UF2 has no blocks for family %08x", family_id);
+    }
+
+    // Any pages of the image not in the file yet get new blocks, added after the last one for the family
+    std::vector<uint32_t> added;
+    uint32_t image_end = address + image.size();
+    for (uint32_t page = address & ~(UF2_PAGE_SIZE - 1); page < image_end; page += UF2_PAGE_SIZE) {
+        if (!present.count(page)) added.push_back(page);
+    }
+    // Copy the image over a block's payload, returning true if it changed
+    auto patch_payload = [&]() {
+        uint32_t from = std::max(block.target_addr, address);
+        uint32_t to = std::min(block.target_addr + UF2_PAGE_SIZE, image_end);
+        if (from >= to) return false;
+        uint8_t *dest = block.data + (from - block.target_addr);
+        const uint8_t *src = image.data() + (from - address);
+        if (!memcmp(dest, src, to - from)) return false;
+        memcpy(dest, src, to - from);
+        return true;
+    };
+
+    // RP2350-E10: keep the absolute block that a full conversion of the image would have added
+    if (!has_abs_block && family_id != ABSOLUTE_FAMILY_ID && family_id != RP2040_FAMILY_ID && abs_block_loc) {
+        address_ranges flash_range = rp2350_address_ranges_flash;
+        if (is_address_initialized(flash_range, *present.begin())) {
+            block = gen_abs_block(abs_block_loc);
+            write_block();
+        }
+    }
+
+    // Second pass copies every block through by index, rewriting only the payloads that changed
+    unsigned int rewritten = 0;
+    in->clear();
+    in->seekg(0, in->beg);
+    for (unsigned int index = 0; read_block(); index++) {
+        if (is_family_page(block, family_id)) {
+            if (patch_payload()) rewritten++;
+            block.num_blocks += added.size();
+        }
+        write_block();
+        if (index == last_index) {
+            for (uint32_t page : added) {
+                block.magic_start0 = UF2_MAGIC_START0;
+                block.magic_start1 = UF2_MAGIC_START1;
+                block.flags = UF2_FLAG_FAMILY_ID_PRESENT;
+                block.target_addr = page;
+                block.payload_size = UF2_PAGE_SIZE;
+                block.block_no = next_block_no++;
+                block.num_blocks = num_blocks + added.size();
+                block.file_size = family_id;
+                block.magic_end = UF2_MAGIC_END;
+                memset(block.data, 0, sizeof(block.data));
+                patch_payload();
+                write_block();
+            }
+        }
+    }
+    if (g_verbose) {
+        printf("Rewrote %d of %d blocks for family %08x, added %d\n", rewritten, family_blocks, family_id, (int)added.size());
+    }
+    return 0;
+}
+
 int elf2uf2(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> out, uint32_t family_id, uint32_t package_addr, uint32_t abs_block_loc, bool verbose) {
     elf_file source_file(verbose);
     g_verbose = verbose;
@@ -10,6 +10,7 @@
 
 #include <cstdio>
 #include <fstream>
+#include <vector>
 
 #include "boot/uf2.h"
 
@@ -23,6 +24,23 @@
 bool check_abs_block(uf2_block block);
 int bin2uf2(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> out, uint32_t address, uint32_t family_id, uint32_t abs_block_loc=0, bool verbose=false);
 int elf2uf2(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> out, uint32_t family_id, uint32_t package_addr=0, uint32_t abs_block_loc=0, bool verbose=false);
+// Writes a contiguous image starting at address to a UF2 as it is produced, so it never needs to be in memory
+struct uf2_stream_writer {
+    uf2_stream_writer(std::shared_ptr<std::iostream> out, uint32_t address, uint32_t size, uint32_t family_id);
+    void write(const uint8_t *data, size_t len);
+    // Pads out and writes the last page
+    void finish();
+private:
+    void flush_page();
+    std::shared_ptr<std::iostream> out;
+    uf2_block block;
+    uint32_t page_fill = 0;
+};
+
+// Copy a UF2 through, replacing the contents of family_id's pages with image (starting at address). Blocks are
+// copied by index, with only changed payloads rewritten, and pages of image not already present are added
+// after the last block for that family. Blocks for any other families are left alone.
+int uf2_patch_family(std::shared_ptr<std::iostream> in, std::shared_ptr<std::iostream> out, uint32_t family_id, uint32_t address, const std::vector<uint8_t> &image, uint32_t abs_block_loc=0, bool verbose=false);
 
 
 #endif
\ No newline at end of file
@@ -20,6 +20,7 @@
 #endif
 #include <cwchar>
 #include <map>
+#include <unordered_map>
 #include <iostream>
 #include <vector>
 #include <set>
@@ -31,6 +32,13 @@
 #include <numeric>
 #include <memory>
 #include <functional>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <bitset>
 
 #include "boot/uf2.h"
 #include "boot/picobin.h"
@@ -43,6 +51,8 @@
     #include "picoboot_connection.h"
 #endif
 #include "bintool.h"
+#include "crc32.h"
+#include "save_writer.h"
 #include "elf2uf2.h"
 #include "boot/bootrom_constants.h"
 #include "pico/binary_info.h"
@@ -54,8 +64,21 @@
 
 #include "nlohmann/json.hpp"
 
+#include <sys/stat.h>
 #if defined(__unix__) || defined(__APPLE__)
 #include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <utime.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+#elif defined(_WIN32)
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
 #endif
 
 // missing __builtins on windows
@@ -168,7 +191,7 @@ std::array<std::array<string, 48>, 12> pin_functions_rp2350{{
     {"",        "",         "UART0 TX", "UART0 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART0 TX", "UART0 RX", "",         "",         "UART0 TX", "UART0 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART0 TX", "UART0 RX", "",         "",         "UART0 TX", "UART0 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART1 TX", "UART1 RX", "",         "",         "UART0 TX", "UART0 RX"}
 }};
 
-std::map<uint32_t, otp_reg> otp_regs;
+otp_reg_map otp_regs;
 
 #if HAS_LIBUSB
 auto bus_device_string = [](struct libusb_device *device, model_t model) {
@@ -481,6 +504,7 @@ struct _settings {
     bool quiet = false;
     bool verbose = false;
     bool use_flash_cache = false;
+    bool map_files = false;
 
     struct {
         int redundancy = -1;
@@ -500,6 +524,7 @@ struct _settings {
         uint32_t row = 0;
         std::vector<std::string> extra_files;
         bool dump_pages = false;
+        string image;
     } otp;
 
     struct {
@@ -510,6 +535,8 @@ struct _settings {
         bool show_device = false;
         bool show_debug = false;
         bool show_build = false;
+        std::vector<std::string> scan_paths;
+        int jobs = 0;
     } info;
 
     struct {
@@ -524,8 +551,15 @@ struct _settings {
         bool no_overwrite = false;
         bool no_overwrite_force = false;
         bool update = false;
+        bool avoid_erase = false;
+        bool staged = false;
+        bool compress = false;
+        bool ab = false;
+        bool watch = false;
         bool ignore_pt = false;
         int partition = -1;
+        uint32_t ab_partner = 0; // flash address of the other slot, set for --ab
+        uint32_t ab_partner_size = 0;
     } load;
 
     struct {
@@ -554,6 +588,8 @@ struct _settings {
     struct {
         bool all = false;
         bool verify = false;
+        bool compress = false;
+        bool sparse = false;
     } save;
 
     struct {
@@ -580,9 +616,11 @@ struct _settings {
         #endif
     } uf2;
 };
-_settings settings;
+// settings, selected_model and fos are per thread, so that jobs such as 'info --scan' can run commands in
+// parallel; the main thread's copies are the ones bound to the command line
+thread_local _settings settings;
 std::shared_ptr<cmd> selected_cmd;
-model_t selected_model = unknown;
+thread_local model_t selected_model = unknown;
 
 auto device_selection =
     (
@@ -597,6 +635,10 @@ auto device_selection =
                 option('F', "--force-no-reboot").set(settings.force_no_reboot) % "Force a device not in BOOTSEL mode but running compatible code to reset so the command can be executed. After executing the command (unless the command itself is a 'reboot') the device will be left connected and accessible to picotool, but without the USB drive mounted"
     ).min(0).doc_non_optional(true).collapse_synopsys("device-selection");
 
+auto otp_image_selection =
+    (option("--image") & value("image").set(settings.otp.image)
+        .if_missing([] { return "missing image file"; })) % "Use an OTP image file instead of a device; 4 bytes/row raw as written by 'otp dump --output' (2 bytes/row ECC images are also accepted). Commands which write create the file if it does not exist";
+
 #define file_types_x(i)\
 (option ('t', "--type") & value("type").set(settings.file_types[i]))\
     % "Specify file type (uf2 | elf | bin) explicitly, ignoring file extension"
@@ -689,7 +731,7 @@ auto file_types = (option ('t', "--type") & value("type").set(settings.file_type
 auto file_selection =
         (
             value("filename").with_exclusion_filter([](const string &value) {
-                    return value.find_first_of('-') == 0;
+                    return value.find_first_of('-') == 0 && value != "-";
                 }).set(settings.filenames[0]) % "The file name" +
             file_types
         );
@@ -698,7 +740,7 @@ struct info_command : public cmd {
     info_command() : cmd("info") {}
     bool execute(device_map& devices) override;
     device_support get_device_support() override {
-        if (settings.filenames[0].empty())
+        if (settings.filenames[0].empty() && settings.info.scan_paths.empty())
             return zero_or_more;
         else
             return none;
@@ -719,7 +761,11 @@ struct info_command : public cmd {
             #if HAS_LIBUSB
                 device_selection % "To target one or more connected RP-series device(s) in BOOTSEL mode (the default)" |
             #endif
-                file_selection % "To target a file"
+                file_selection % "To target a file" |
+                (
+                    (option("--scan") & value("path").add_to(settings.info.scan_paths).repeatable()) % "Files and directories to scan; directories are searched recursively for ELF, UF2 and BIN files, and - reads a list of paths from stdin" +
+                    (option('j', "--jobs") & integer("jobs").min_value(1).set(settings.info.jobs)) % "Number of files to process in parallel (default is the number of CPUs)"
+                ) % "To target many files, printing the information for each in turn"
             ).major_group("TARGET SELECTION").min(0).doc_non_optional(true)
          );
     }
@@ -808,6 +854,8 @@ struct save_command : public cmd {
                 ).min(0).doc_non_optional(true)
             ).min(0).doc_non_optional(true).no_match_beats_error(false) % "Selection of data to save" +
             option('v', "--verify").set(settings.save.verify) % "Verify the data was saved correctly" +
+            option("--compress").set(settings.save.compress) % "Read flash through a helper on the device, which sends erased and zero filled sectors as a single byte, and compresses the rest (RP2040 only)" +
+            option("--sparse").set(settings.save.sparse) % "Don't read erased flash sectors from the device, and leave them out of UF2 files. BIN files are written with holes for pages of zeros (RP2040 only)" +
             (option("--family") % "Specify the family ID to save the file as" &
                 family_id("family_id").set(settings.family_id) % "family ID to save file as").force_expand_help(true) +
             ( // note this parenthesis seems to help with error messages for say save --foo
@@ -836,8 +884,13 @@ struct load_command : public cmd {
                 option('n', "--no-overwrite").set(settings.load.no_overwrite) % "When writing flash data, do not overwrite an existing program in flash. If picotool cannot determine the size/presence of the program in flash, the command fails" +
                 option('N', "--no-overwrite-unsafe").set(settings.load.no_overwrite_force) % "When writing flash data, do not overwrite an existing program in flash. If picotool cannot determine the size/presence of the program in flash, the load continues anyway" +
                 option('u', "--update").set(settings.load.update) % "Skip writing flash sectors that already contain identical data" +
+                option("--avoid-erase").set(settings.load.avoid_erase) % "Only erase flash sectors where the new data sets bits that are currently clear; other sectors are programmed in place, and only pages that differ are written" +
+                option("--ab").set(settings.load.ab) % "Update a partition that is one slot of an A/B pair (by default the slot chosen by the bootrom). Both slots are read, and only the flash sectors that differ from this slot's current contents are erased and programmed; the summary reports how many sectors differ from the other slot (RP2350 only)" +
+                option("--staged").set(settings.load.staged) % "Program flash with a helper running on the device, which erases and programs each batch while the next is sent (RP2040 only)" +
+                option("--compress").set(settings.load.compress) % "Send flash data compressed, to be decompressed by the --staged helper on the device. If the helper can't be used, the data is sent uncompressed" +
                 option('v', "--verify").set(settings.load.verify) % "Verify the data was written correctly" +
-                option('x', "--execute").set(settings.load.execute) % "Attempt to execute the downloaded file as a program after the load"
+                option('x', "--execute").set(settings.load.execute) % "Attempt to execute the downloaded file as a program after the load" +
+                option("--watch").set(settings.load.watch) % "After the load, keep the device connected and wait for the file to change, then erase and program only the flash sectors that differ from those last loaded, until interrupted. With -x the program is executed after each load, and if it has a USB reset interface the device is then asked to reboot into BOOTSEL mode for the next one; otherwise it must be put in BOOTSEL mode by hand"
             ).min(0).doc_non_optional(true) % "Post load actions" +
             file_selection % "File to load from" +
             (
@@ -1100,6 +1153,9 @@ struct otp_get_command : public cmd {
     otp_get_command() : cmd("get") {}
     bool execute(device_map& devices) override;
     virtual bool requires_rp2350() const override { return true; }
+    device_support get_device_support() override {
+        return settings.otp.image.empty() ? one : none;
+    }
 
     group get_cli() override {
         return (
@@ -1111,7 +1167,8 @@ struct otp_get_command : public cmd {
                         (option('i', "--include") & value("filename").add_to(settings.otp.extra_files)).min(0).max(1) % "Include extra otp definition" // todo more than 1
                 ).min(0).doc_non_optional(true) % "Row/field options" +
                 (
-                        device_selection % "Target device selection"
+                        device_selection % "Target device selection" |
+                        otp_image_selection % "Target OTP image"
                 ).major_group("TARGET SELECTION").min(0).doc_non_optional(true) +
                 (
                         option('z', "--fuzzy").set(settings.otp.fuzzy) % "Allow fuzzy name searches in selector vs exact match" +
@@ -1141,7 +1198,7 @@ struct otp_dump_command : public cmd {
     bool execute(device_map& devices) override;
     virtual bool requires_rp2350() const override { return true; }
     device_support get_device_support() override {
-        if (settings.filenames[0].empty())
+        if (settings.filenames[0].empty() && settings.otp.image.empty())
             return one;
         else
             return none;
@@ -1157,7 +1214,8 @@ struct otp_dump_command : public cmd {
                 ).min(0).doc_non_optional(true) % "Row/field options" +
                 (
                         device_selection % "To dump the contents of a target device" |
-                        named_typed_file_selection_x("input", 0, "json") % "To dump the contents of an OTP JSON file"
+                        named_typed_file_selection_x("input", 0, "json") % "To dump the contents of an OTP JSON file" |
+                        otp_image_selection % "To dump the contents of an OTP image"
                 ).major_group("TARGET SELECTION").min(0).doc_non_optional(true)
         );
     }
@@ -1171,6 +1229,9 @@ struct otp_load_command : public cmd {
     otp_load_command() : cmd("load") {}
     bool execute(device_map &devices) override;
     virtual bool requires_rp2350() const override { return true; }
+    device_support get_device_support() override {
+        return settings.otp.image.empty() ? one : none;
+    }
 
     group get_cli() override {
         return (
@@ -1181,7 +1242,10 @@ struct otp_load_command : public cmd {
                         (option('i', "--include") & value("filename").add_to(settings.otp.extra_files)).min(0).max(1) % "Include extra otp definition" // todo more than 1
                 ).min(0).doc_non_optional(true) % "Row options" +
                 named_typed_file_selection_x("filename", 0, "json | bin") % "File to load row(s) from" +
-                device_selection % "Target device selection"
+                (
+                        device_selection % "Target device selection" |
+                        otp_image_selection % "Target OTP image"
+                ).min(0).doc_non_optional(true)
         );
     }
 
@@ -1193,6 +1257,9 @@ struct otp_load_command : public cmd {
 struct otp_set_command : public cmd {
     otp_set_command() : cmd("set") {}
     virtual bool requires_rp2350() const override { return true; }
+    device_support get_device_support() override {
+        return settings.otp.image.empty() ? one : none;
+    }
 
     bool execute(device_map& devices) override;
 
@@ -1220,7 +1287,8 @@ struct otp_set_command : public cmd {
                 ) % "Row/Field Selection" +
                 integer("value").set(settings.otp.value) % "The value to set" +
                 (
-                        device_selection % "Target device selection"
+                        device_selection % "Target device selection" |
+                        otp_image_selection % "Target OTP image"
                 ).major_group("TARGET SELECTION").min(0).doc_non_optional(true)
         );
     }
@@ -1257,6 +1325,9 @@ struct otp_permissions_command : public cmd {
 struct otp_white_label_command : public cmd {
     otp_white_label_command() : cmd("white-label") {}
     virtual bool requires_rp2350() const override { return true; }
+    device_support get_device_support() override {
+        return settings.otp.image.empty() ? one : none;
+    }
 
     bool execute(device_map& devices) override;
 
@@ -1266,7 +1337,10 @@ struct otp_white_label_command : public cmd {
                         (option('s', "--start_row") & integer("row").set(settings.otp.row)) % "Start row for white label struct (default 0x100) (note use 0x for hex)"
                 ).min(0).doc_non_optional(true) % "Row options" +
                 named_untyped_file_selection_x("filename", 0) % "JSON file with white labelling values" +
-                device_selection % "Target device selection"
+                (
+                        device_selection % "Target device selection" |
+                        otp_image_selection % "Target OTP image"
+                ).min(0).doc_non_optional(true)
         );
     }
 
@@ -1524,7 +1598,7 @@ clipp::formatting_ostream<std::ostream> fos_null(null_buffer);
 
 auto fos_base_ptr = std::make_shared<clipp::formatting_ostream<std::ostream>>(fos_base);
 auto fos_null_ptr = std::make_shared<clipp::formatting_ostream<std::ostream>>(fos_null);
-auto fos_ptr = fos_base_ptr;
+thread_local auto fos_ptr = fos_base_ptr;
 #define fos (*fos_ptr)
 #define fos_verbose if(settings.verbose) fos
 
@@ -1997,6 +2071,9 @@ static rp2350_version_t get_rp2350_version(memory_access &raw_access) {
     }
 }
 #if HAS_LIBUSB
+// RP2040 boot ROM contents read from devices, by ROM version; every device with the same version has the same ROM
+static std::map<uint8_t, vector<uint8_t>> rp2040_rom_images;
+
 struct picoboot_memory_access : public memory_access {
     model_t model = unknown; // must be initialized to something up front as it is referenced before it is set to its final value
     explicit picoboot_memory_access(picoboot::connection &connection) : connection(connection) {
@@ -2079,19 +2156,13 @@ struct picoboot_memory_access : public memory_access {
             connection.exit_xip();
         }
         if (model == rp2040 && rom == get_memory_type(address, model) && (address+size) >= 0x2000) {
-            // read by memcpy instead
-            unsigned int program_base = SRAM_START + 0x4000;
-            // program is "return memcpy(SRAM_BASE, 0, 0x4000);"
-            std::vector<uint32_t> program = {
-                    0x07482101, // movs r1, #1;       lsls r0, r1, #29
-                    0x2100038a, // lsls r2, r1, #14;  movs r1, #0
-                    0x47184b00, // ldr  r3, [pc, #0]; bx r3
-                    bootrom_func_lookup(*this, rom_table_code('M','C'))
-            };
-            write_vector(program_base, program);
-            connection.exec(program_base);
-            // 4k is copied into the start of RAM
-            connection.read(SRAM_START + address, (uint8_t *) buffer, size);
+            const vector<uint8_t> &image = get_rp2040_rom_image();
+            if (address + size > image.size()) {
+                std::stringstream sstream;
+                sstream << "Address range " << hex_string(address) << " + " << hex_string(size);
+                throw std::invalid_argument(sstream.str());
+            }
+            memcpy(buffer, image.data() + address, size);
         } else if (model == rp2350 && rom == get_memory_type(address, model) && (address+size) > 0x7e00) {
             // Cannot read end section of rom from device
             uint16_t unreadable_start = MAX(address, 0x7e00);
@@ -2123,6 +2194,32 @@ struct picoboot_memory_access : public memory_access {
         }
     }
 
+    // The top half of the RP2040 ROM can't be read over PICOBOOT, so the whole ROM is copied to RAM on the device
+    // by memcpy and read from there. This is only done the first time each ROM version is seen.
+    const vector<uint8_t> &get_rp2040_rom_image() {
+        uint8_t rom_version;
+        connection.read(0x13, &rom_version, sizeof(rom_version));
+        auto &image = rp2040_rom_images[rom_version];
+        if (image.empty()) {
+            unsigned int program_base = SRAM_START + 0x4000;
+            // program is "return memcpy(SRAM_BASE, 0, 0x4000);"
+            std::vector<uint32_t> program = {
+                    0x07482101, // movs r1, #1;       lsls r0, r1, #29
+                    0x2100038a, // lsls r2, r1, #14;  movs r1, #0
+                    0x47184b00, // ldr  r3, [pc, #0]; bx r3
+                    bootrom_func_lookup(*this, rom_table_code('M','C'))
+            };
+            write_vector(program_base, program);
+            connection.exec(program_base);
+            // 16k is copied into the start of RAM
+            vector<uint8_t> data(ROM_END_RP2040 - ROM_START);
+            connection.read(SRAM_START, data.data(), data.size());
+            image.swap(data);
+            DEBUG_LOG("Read RP2040 ROM version %d\n", rom_version);
+        }
+        return image;
+    }
+
     // note this does not automatically erase flash unless erase is set
     void write(uint32_t address, uint8_t *buffer, unsigned int size) override {
         vector<uint8_t> write_data; // used when erasing flash
@@ -2262,15 +2359,290 @@ private:
 
 
 struct file_memory_access : public iostream_memory_access {
-    file_memory_access(std::shared_ptr<std::fstream> file, range_map<size_t>& rmap, uint32_t binary_start) : iostream_memory_access(file, rmap, binary_start), file(file) {
+    file_memory_access(std::shared_ptr<std::iostream> file, range_map<size_t>& rmap, uint32_t binary_start) : iostream_memory_access(file, rmap, binary_start), file(file) {
         
     }
 
     ~file_memory_access() {
-        file->close();
+        auto fstream = std::dynamic_pointer_cast<std::fstream>(file);
+        if (fstream) fstream->close();
+    }
+private:
+    std::shared_ptr<std::iostream>file;
+};
+
+// Read-only stream over a whole file mapped into memory, so seeks and reads don't need system calls
+struct mapped_file_stream : public std::iostream {
+    ~mapped_file_stream() {
+    #if defined(__unix__) || defined(__APPLE__)
+        munmap(data, size);
+    #endif
+    }
+
+    // Returns nullptr if the file can't be mapped, in which case the caller should fall back to an fstream
+    static std::shared_ptr<mapped_file_stream> open(const string &filename) {
+    #if defined(__unix__) || defined(__APPLE__)
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+        struct stat st;
+        void *data = MAP_FAILED;
+        if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+            data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (data == MAP_FAILED) return nullptr;
+        return std::shared_ptr<mapped_file_stream>(new mapped_file_stream((char *)data, st.st_size));
+    #else
+        return nullptr;
+    #endif
+    }
+
+    const uint8_t *bytes() const { return (const uint8_t *)data; }
+    size_t length() const { return size; }
+
+private:
+    struct buffer : public std::streambuf {
+        buffer(char *data, size_t size) { setg(data, data, data + size); }
+
+        pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+            off_type pos = off;
+            if (dir == std::ios_base::cur) pos += gptr() - eback();
+            else if (dir == std::ios_base::end) pos += egptr() - eback();
+            if (!(which & std::ios_base::in) || pos < 0 || pos > egptr() - eback()) return pos_type(off_type(-1));
+            setg(eback(), eback() + pos, egptr());
+            return pos_type(pos);
+        }
+
+        pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+            return seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    mapped_file_stream(char *data, size_t size) : std::iostream(nullptr), data(data), size(size), buf(data, size) {
+        rdbuf(&buf);
+    }
+
+    char *data;
+    size_t size;
+    buffer buf;
+};
+
+// 64-bit FNV-1a, continuing from h
+static uint64_t fnv1a_64(const void *data, size_t len, uint64_t h = 0xcbf29ce484222325ull) {
+    auto bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Opt-in on-disk cache of the results of parsing and converting input files, for build pipelines which run several
+// commands over the same ELF. It is enabled by setting PICOTOOL_CACHE_DIR, and PICOTOOL_CACHE_SIZE bounds its size in
+// MB (default 64). Entries are named by a hash of the input file's contents and of the options that affect the result,
+// and only used if the input size and SHA-256 digest stored in them match too, so neither a hash collision nor a
+// crafted input can pick up another file's result. They are checked against their CRC when mapped, and the least
+// recently used are removed when the cache is over size. New entries are written to a temporary file and renamed
+// into place, so concurrent runs can share a cache.
+struct conversion_cache {
+    // A cached result; uf2 points into the mapped entry
+    struct entry {
+        uint32_t family_id = 0;     // family converted for, or detected from the image's blocks (0 if unknown)
+        uint32_t binary_start = 0;
+        vector<tuple<uint32_t, uint32_t, uint32_t>> ranges; // page map of address range and file offset
+        const uint8_t *uf2 = nullptr;
+        uint32_t uf2_size = 0;
+        std::shared_ptr<mapped_file_stream> mapping;
+    };
+
+    // The contents of an input file together with the options it is converted with
+    struct input_id {
+        uint64_t key = 0;   // names the entry; 0 if the file can't be read
+        uint64_t size = 0;
+        uint8_t digest[32] = {}; // SHA-256, see identify
+    };
+
+    // Returns nullptr if the cache is not enabled
+    static std::unique_ptr<conversion_cache> open() {
+    #if (defined(__unix__) || defined(__APPLE__)) && HAS_MBEDTLS
+        const char *dir = getenv("PICOTOOL_CACHE_DIR");
+        if (!dir || !*dir) return nullptr;
+        uint64_t max_mb = 64;
+        const char *size = getenv("PICOTOOL_CACHE_SIZE");
+        if (size && *size) {
+            char *end;
+            max_mb = strtoull(size, &end, 10);
+            if (*end) fail(ERROR_ARGS, "PICOTOOL_CACHE_SIZE must be a size in MB");
+        }
+        if (mkdir(dir, 0777) && errno != EEXIST) {
+            fos << "WARNING: Unable to create cache directory " << dir << "\n";
+            return nullptr;
+        }
+        return std::unique_ptr<conversion_cache>(new conversion_cache(dir, max_mb << 20));
+    #else
+        // entries are used by mapping them, and identified by a SHA-256 digest
+        return nullptr;
+    #endif
+    }
+
+    // Identifies the contents of input file idx converted with options
+    input_id identify(uint8_t idx, const vector<uint32_t> &options) const {
+        input_id id;
+    #if HAS_MBEDTLS
+        auto input = mapped_file_stream::open(settings.filenames[idx]);
+        if (!input) return id;
+        uint64_t h = fnv1a_64(PICOTOOL_VERSION, strlen(PICOTOOL_VERSION));
+        h = fnv1a_64(options.data(), options.size() * sizeof(uint32_t), h);
+        h = fnv1a_64(input->bytes(), input->length(), h);
+        id.key = h ? h : 1;
+        id.size = input->length();
+        // digest of the input's digest followed by the version and options
+        message_digest_t input_digest;
+        sha256_buffer(input->bytes(), input->length(), &input_digest);
+        vector<uint8_t> to_hash(input_digest.bytes, input_digest.bytes + sizeof(input_digest.bytes));
+        to_hash.insert(to_hash.end(), PICOTOOL_VERSION, PICOTOOL_VERSION + strlen(PICOTOOL_VERSION) + 1);
+        to_hash.insert(to_hash.end(), (const uint8_t *)options.data(), (const uint8_t *)(options.data() + options.size()));
+        message_digest_t digest;
+        sha256_buffer(to_hash.data(), to_hash.size(), &digest);
+        static_assert(sizeof(digest.bytes) == sizeof(id.digest), "");
+        memcpy(id.digest, digest.bytes, sizeof(id.digest));
+    #endif
+        return id;
+    }
+
+    // The entry for id, or nullptr if it is missing, belongs to a different input, or is damaged (in which case it
+    // is removed)
+    std::unique_ptr<entry> find(const input_id &id) const {
+        string name = path(id.key);
+        auto mapping = mapped_file_stream::open(name);
+        if (!mapping) return nullptr;
+        const uint8_t *data = mapping->bytes();
+        uint64_t size = mapping->length();
+        header h;
+        bool ok = size >= sizeof(h);
+        if (ok) {
+            memcpy(&h, data, sizeof(h));
+            ok = h.magic == MAGIC && h.version == VERSION && h.key == id.key &&
+                 size == sizeof(h) + (uint64_t)h.range_count * RANGE_SIZE + h.uf2_size &&
+                 h.crc == crc32_reflected_update(0xffffffff, data + sizeof(h), size - sizeof(h));
+        }
+        if (ok && (h.input_size != id.size || memcmp(h.digest, id.digest, sizeof(h.digest)))) {
+            // another input with the same key, which storing this one's result will replace
+            fos_verbose << "Ignoring cache entry " << name << " for a different input\n";
+            return nullptr;
+        }
+        if (!ok) {
+            fos_verbose << "Removing damaged cache entry " << name << "\n";
+            remove(name.c_str());
+            return nullptr;
+        }
+    #if defined(__unix__) || defined(__APPLE__)
+        utime(name.c_str(), nullptr); // most recently used
+    #endif
+        std::unique_ptr<entry> e(new entry);
+        e->family_id = h.family_id;
+        e->binary_start = h.binary_start;
+        const uint8_t *pos = data + sizeof(h);
+        for (uint32_t i = 0; i < h.range_count; i++, pos += RANGE_SIZE) {
+            uint32_t r[3];
+            memcpy(r, pos, RANGE_SIZE);
+            e->ranges.emplace_back(r[0], r[1], r[2]);
+        }
+        e->uf2 = pos;
+        e->uf2_size = h.uf2_size;
+        e->mapping = mapping;
+        fos_verbose << "Using cache entry " << name << "\n";
+        return e;
+    }
+
+    // Adds an entry for id; failures are ignored, as the result can always be computed again
+    void store(const input_id &id, const entry &e) const {
+    #if defined(__unix__) || defined(__APPLE__)
+        vector<uint32_t> ranges;
+        for (const auto &r : e.ranges) {
+            ranges.insert(ranges.end(), {std::get<0>(r), std::get<1>(r), std::get<2>(r)});
+        }
+        uint32_t ranges_size = ranges.size() * sizeof(uint32_t);
+        header h = {MAGIC, VERSION, id.key, e.family_id, e.binary_start, (uint32_t)e.ranges.size(), e.uf2_size, 0, 0,
+                    id.size, {}};
+        memcpy(h.digest, id.digest, sizeof(h.digest));
+        h.crc = crc32_reflected_update(crc32_reflected_update(0xffffffff, ranges.data(), ranges_size), e.uf2, e.uf2_size);
+        string name = path(id.key);
+        // a unique temporary file, as other threads (info --scan) or processes may be storing the same key
+        string tmp = name + ".tmpXXXXXX";
+        int fd = mkstemp(&tmp[0]);
+        if (fd < 0) return;
+        FILE *out = fdopen(fd, "wb");
+        if (!out) {
+            close(fd);
+            remove(tmp.c_str());
+            return;
+        }
+        bool ok = fwrite(&h, sizeof(h), 1, out) == 1 &&
+                  (!ranges_size || fwrite(ranges.data(), ranges_size, 1, out) == 1) &&
+                  (!e.uf2_size || fwrite(e.uf2, e.uf2_size, 1, out) == 1);
+        if (fclose(out)) ok = false;
+        if (!ok || rename(tmp.c_str(), name.c_str())) {
+            remove(tmp.c_str());
+            return;
+        }
+        evict();
+    #endif
     }
+
 private:
-    std::shared_ptr<std::fstream>file;
+    static constexpr uint32_t MAGIC = 0x43435450; // "PTCC"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t RANGE_SIZE = 3 * sizeof(uint32_t);
+
+    struct header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t family_id;
+        uint32_t binary_start;
+        uint32_t range_count;   // followed by the ranges, then the UF2
+        uint32_t uf2_size;
+        uint32_t crc;           // of everything after the header
+        uint32_t reserved;
+        uint64_t input_size;
+        uint8_t digest[32];     // of the input, see identify
+    };
+
+    conversion_cache(const string &dir, uint64_t max_size) : dir(dir), max_size(max_size) {}
+
+    string path(uint64_t key) const {
+        char name[24];
+        snprintf(name, sizeof(name), "%016" PRIx64 ".ptc", key);
+        return dir + "/" + name;
+    }
+
+    // Remove the least recently used entries until the cache fits in max_size
+    void evict() const {
+    #if defined(__unix__) || defined(__APPLE__)
+        DIR *d = opendir(dir.c_str());
+        if (!d) return;
+        vector<tuple<time_t, uint64_t, string>> entries;
+        uint64_t total = 0;
+        while (struct dirent *ent = readdir(d)) {
+            string name = ent->d_name;
+            if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".ptc")) continue;
+            struct stat st;
+            if (stat((dir + "/" + name).c_str(), &st)) continue;
+            entries.emplace_back(st.st_mtime, st.st_size, dir + "/" + name);
+            total += st.st_size;
+        }
+        closedir(d);
+        std::sort(entries.begin(), entries.end());
+        for (const auto &e : entries) {
+            if (total <= max_size) break;
+            remove(std::get<2>(e).c_str());
+            total -= std::get<1>(e);
+        }
+    #endif
+    }
+
+    string dir;
+    uint64_t max_size;
 };
 
 struct remapped_memory_access : public memory_access {
@@ -2784,6 +3156,25 @@ uint32_t guess_flash_size(memory_access &access) {
     return size * 2;
 }
 
+#if HAS_LIBUSB
+// The flash size from its SFDP tables where available, otherwise guessed as above; limited to the part of the
+// flash which is mapped into the address space
+uint32_t get_flash_size(picoboot::connection &con, memory_access &access) {
+    uint32_t size = con.get_flash_geometry().size;
+    if (!size) return guess_flash_size(access);
+    uint32_t max_size = (con.get_model() == rp2040 ? FLASH_END_RP2040 : FLASH_END_RP2350) - FLASH_START;
+    return std::min(size, max_size);
+}
+
+// Erases are issued in aligned blocks of this size where possible, so the bootrom can use 64K block erases
+// instead of erasing each 4K sector in turn; unless the flash says it has no 64K erase
+uint32_t get_flash_erase_block_size(picoboot::connection &con) {
+    uint32_t erase_sizes = con.get_flash_geometry().erase_sizes;
+    if (erase_sizes && !(erase_sizes & (1u << 16))) return FLASH_SECTOR_ERASE_SIZE;
+    return 1u << 16;
+}
+#endif
+
 // returns true if string is a hex string, and fills array with the values
 bool string_to_hex_array(const string& str, uint8_t *array, size_t size, const string& error_msg) {
 
@@ -2816,6 +3207,10 @@ std::shared_ptr<std::fstream> get_file(ios::openmode mode) {
     return get_file_idx(mode, 0);
 }
 
+bool same_file_idx(uint8_t a, uint8_t b) {
+    return is_same_file(settings.filenames[a], settings.filenames[b]);
+}
+
 enum filetype get_file_type_idx(uint8_t idx) {
     auto filename = settings.filenames[idx];
     auto file_type = settings.file_types[idx];
@@ -3009,6 +3404,10 @@ template <typename ACCESS, typename STREAM> ACCESS get_iostream_memory_access(st
 }
 
 file_memory_access get_file_memory_access(uint8_t idx, bool writeable = false, uint32_t *next_family_id=nullptr) {
+    if (settings.map_files && !writeable) {
+        auto mapped = mapped_file_stream::open(settings.filenames[idx]);
+        if (mapped) return get_iostream_memory_access<file_memory_access>(mapped, get_file_type_idx(idx), false, next_family_id);
+    }
     ios::openmode mode = (writeable ? ios::out|ios::in : ios::in)|ios::binary;
     auto file = get_file_idx(mode, idx);
     try {
@@ -3019,6 +3418,204 @@ file_memory_access get_file_memory_access(uint8_t idx, bool writeable = false, u
     }
 }
 
+uint32_t get_access_family_id(memory_access &file_access);
+
+// An input file parsed once up front: the file is opened (or mapped) a single time, and a UF2 is scanned in
+// one pass that builds the address map for every family it contains. Memory accesses created from it share
+// the open file, and apply the current --offset when they are created, so stages that change the offset
+// don't need to rescan the file.
+struct parsed_image {
+    explicit parsed_image(uint8_t idx) : type(get_file_type_idx(idx)) {
+        if (settings.map_files) file = mapped_file_stream::open(settings.filenames[idx]);
+        if (!file) file = get_file_idx(ios::in|ios::binary, idx);
+        try {
+            switch (type) {
+                case filetype::bin:
+                    file->seekg(0, std::ios::end);
+                    families.push_back({0, {}, 0, 0});
+                    families.back().rmap.insert(range(0, (uint32_t)file->tellg()), 0);
+                    break;
+                case filetype::elf:
+                    families.push_back({0, {}, 0, 0});
+                    if (!read_elf_from_cache(idx)) {
+                        build_rmap_elf(file, families.back().rmap);
+                        families.back().binary_start = find_binary_start(families.back().rmap);
+                    }
+                    break;
+                case filetype::uf2:
+                    scan_uf2();
+                    break;
+                default:
+                    fail(ERROR_INCOMPATIBLE, "Cannot create memory access with filetype %s", getFiletypeName(type).c_str());
+            }
+        } catch (std::exception&) {
+            close();
+            throw;
+        }
+    }
+
+    ~parsed_image() {
+        close();
+    }
+
+    parsed_image(const parsed_image&) = delete;
+    parsed_image& operator=(const parsed_image&) = delete;
+
+    enum filetype get_type() const {
+        return type;
+    }
+
+    // Family of the first UF2 block, or 0 for other file types
+    uint32_t get_first_family_id() const {
+        return first_family_id;
+    }
+
+    // The family following family_id in the UF2 (in the same order as get_file_memory_access reports them), or 0
+    uint32_t get_next_family_id(uint32_t family_id) const {
+        auto f = find(family_id);
+        return f ? f->next_family_id : 0;
+    }
+
+    bool has_multiple_families() const {
+        return families.size() > 1;
+    }
+
+    // Access to the image for family_id (or the first family if 0), with the current --offset applied
+    iostream_memory_access access(uint32_t family_id = 0) const {
+        auto f = find(family_id);
+        range_map<size_t> rmap = f ? f->rmap : range_map<size_t>();
+        uint32_t binary_start = f ? f->binary_start : 0;
+        if (type == filetype::bin) {
+            binary_start = settings.offset_set ? settings.offset : FLASH_START;
+            rmap = rmap.offset_by(binary_start);
+        } else if (settings.offset_set) {
+            unsigned int rel_offset = settings.offset - binary_start;
+            rmap = rmap.offset_by(rel_offset);
+            binary_start = settings.offset;
+            DEBUG_LOG("BINARY START now %08x, rmaps offset by %08x\n", binary_start, rel_offset);
+        }
+        return iostream_memory_access(file, rmap, binary_start);
+    }
+
+    // Family ID detected from the image's blocks (for ELF and BIN), cached after the first lookup
+    uint32_t detected_family_id = 0;
+
+private:
+    struct family {
+        uint32_t family_id;
+        range_map<size_t> rmap;
+        uint32_t binary_start;
+        uint32_t next_family_id;
+    };
+
+    // family_id 0 finds the first family
+    const family *find(uint32_t family_id) const {
+        if (families.empty()) return nullptr;
+        if (!family_id) return &families.front();
+        for (const auto &f : families) {
+            if (f.family_id == family_id) return &f;
+        }
+        return nullptr;
+    }
+
+    // Take an ELF's page map and family from the conversion cache, if it is enabled. On a miss, the page map is built
+    // and the family detected here (before any --offset is applied, as in the cache), and both are added to the cache
+    bool read_elf_from_cache(uint8_t idx) {
+        auto cache = conversion_cache::open();
+        auto id = cache ? cache->identify(idx, {(uint32_t)type}) : conversion_cache::input_id();
+        if (!id.key) return false;
+        auto &f = families.back();
+        uint32_t family_id;
+        auto cached = cache->find(id);
+        if (cached) {
+            for (const auto &r : cached->ranges) {
+                f.rmap.insert(range(std::get<0>(r), std::get<1>(r)), std::get<2>(r));
+            }
+            f.binary_start = cached->binary_start;
+            family_id = cached->family_id;
+        } else {
+            build_rmap_elf(file, f.rmap);
+            f.binary_start = find_binary_start(f.rmap);
+            conversion_cache::entry e;
+            e.binary_start = f.binary_start;
+            for (auto r : f.rmap.ranges()) {
+                e.ranges.emplace_back(r.from, r.to, (uint32_t)f.rmap.get(r.from).second);
+            }
+            try {
+                iostream_memory_access access(file, f.rmap, f.binary_start);
+                e.family_id = get_access_family_id(access);
+            } catch (std::exception&) {
+                // left for get_family_id to report, if it is needed
+            }
+            cache->store(id, e);
+            family_id = e.family_id;
+        }
+        if (!settings.offset_set) detected_family_id = family_id;
+        return true;
+    }
+
+    // Equivalent to calling build_rmap_uf2 once per family, but reading the file once
+    void scan_uf2() {
+        file->seekg(0, ios::beg);
+        uf2_block block;
+        unsigned int pos = 0;
+        do {
+            file->read((char*)&block, sizeof(uf2_block));
+            if (file->fail()) {
+                if (file->eof()) { file->clear(); break; }
+                fail(ERROR_READ_FAILED, "unexpected end of input file");
+            }
+            bool abs_block = false;
+            #if SUPPORT_A2
+            abs_block = check_abs_block(block);
+            #endif
+            if (!pos || (pos == sizeof(uf2_block) && first_is_abs)) {
+                if (abs_block && !pos) first_is_abs = true;
+                else first_family_id = block.file_size;
+            }
+            if (block.magic_start0 == UF2_MAGIC_START0 && block.magic_start1 == UF2_MAGIC_START1 &&
+                block.magic_end == UF2_MAGIC_END) {
+                bool loadable = block.flags & UF2_FLAG_FAMILY_ID_PRESENT &&
+                    !(block.flags & UF2_FLAG_NOT_MAIN_FLASH) && block.payload_size == PAGE_SIZE;
+                if (loadable && abs_block) {
+                    DEBUG_LOG("Ignoring RP2350-E10 absolute block\n");
+                    settings.uf2.abs_block_loc = block.target_addr;
+                } else if (loadable) {
+                    auto f = std::find_if(families.begin(), families.end(), [&](const family &f) {
+                        return f.family_id == block.file_size;
+                    });
+                    if (f == families.end()) {
+                        families.push_back({block.file_size, {}, 0, 0});
+                        f = families.end() - 1;
+                    }
+                    f->rmap.insert(range(block.target_addr, block.target_addr + PAGE_SIZE), pos + offsetof(uf2_block, data[0]));
+                    f->next_family_id = 0;
+                }
+                if (!abs_block) {
+                    for (auto &f : families) {
+                        if (f.family_id != block.file_size && !f.next_family_id) f.next_family_id = block.file_size;
+                    }
+                }
+            }
+            pos += sizeof(uf2_block);
+        } while (true);
+        for (auto &f : families) {
+            f.binary_start = find_binary_start(f.rmap);
+        }
+    }
+
+    void close() {
+        auto fstream = std::dynamic_pointer_cast<std::fstream>(file);
+        if (fstream) fstream->close();
+    }
+
+    std::shared_ptr<std::iostream> file;
+    enum filetype type;
+    vector<family> families;
+    uint32_t first_family_id = 0;
+    bool first_is_abs = false;
+};
+
 const char *cpu_name(unsigned int cpu) {
     if (cpu == PICOBIN_IMAGE_TYPE_EXE_CPU_ARM) return "ARM";
     if (cpu == PICOBIN_IMAGE_TYPE_EXE_CPU_RISCV) return "RISC-V";
@@ -3190,18 +3787,135 @@ void insert_default_families(uint32_t flags_and_permissions, vector<std::string>
     if (flags_and_permissions & PICOBIN_PARTITION_FLAGS_ACCEPTS_DEFAULT_FAMILY_DATA_BITS) family_ids.emplace_back(family_name(DATA_FAMILY_ID));
 }
 
+void set_default_info_groups() {
+    if (!settings.info.show_basic && !settings.info.all && !settings.info.show_metadata && !settings.info.show_pins && !settings.info.show_device && !settings.info.show_debug && !settings.info.show_build) {
+        settings.info.show_basic = true;
+    }
+    if (settings.info.show_debug && !settings.info.show_device) {
+        settings.info.show_device = true;
+    }
+}
+
+// Hash/signature checks for one image shown by info. These are gathered for all the images up front, doing
+// the reads in the same order info_guts would, then run together by run_info_verifications. info_guts then
+// takes the results in order, falling back to verifying inline if a block doesn't match the next one queued
+struct info_verification {
+    struct job {
+        std::shared_ptr<block> blk;
+        vector<uint8_t> to_hash;
+        verified_t hash_verified = none;
+        verified_t sig_verified = none;
+        std::exception_ptr error;
+    };
+
+    bool take(block *current_block, verified_t &hash_verified, verified_t &sig_verified) {
+        if (next >= jobs.size()) return false;
+        const auto &j = jobs[next];
+        if (j.blk->physical_addr != current_block->physical_addr || j.blk->to_words() != current_block->to_words()) {
+            DEBUG_LOG("Block at %x doesn't match queued verification, so verifying now\n", current_block->physical_addr);
+            return false;
+        }
+        next++;
+        if (j.error) std::rethrow_exception(j.error);
+        hash_verified = j.hash_verified;
+        sig_verified = j.sig_verified;
+        return true;
+    }
+
+    vector<job> jobs;
+    size_t next = 0;
+};
+
+// Callback to pass to bintool, to get more bin data
+get_more_bin_cb info_more_cb(memory_access &raw_access) {
+    return [&raw_access](std::vector<uint8_t> &bin, uint32_t offset, uint32_t size) {
+        DEBUG_LOG("Now reading from %x size %x\n", offset, size);
+        bin = raw_access.read_vector<uint8_t>(offset, size, true);
+    };
+}
+
+std::shared_ptr<info_verification> prepare_info_verification(memory_access &raw_access) {
+#if HAS_MBEDTLS
+    set_default_info_groups();
+    settings.use_flash_cache = true;
+    get_more_bin_cb more_cb = info_more_cb(raw_access);
+    auto verification = std::make_shared<info_verification>();
+    auto queue = [&](std::unique_ptr<block> blk) {
+        info_verification::job j;
+        j.blk = std::move(blk);
+        j.to_hash = get_verify_data({}, raw_access.get_binary_start(), raw_access.get_binary_start(), j.blk.get(), more_cb);
+        verification->jobs.push_back(std::move(j));
+    };
+    try {
+        // Same blocks, in the same order, as info_guts
+        vector<uint8_t> bin;
+        if (settings.info.show_metadata || settings.info.all) {
+            bin = raw_access.read_vector<uint8_t>(raw_access.get_binary_start(), 0x1000, true);
+            std::unique_ptr<block> first_block = find_first_block(bin, raw_access.get_binary_start());
+            if (first_block) {
+                auto all_blocks = get_all_blocks(bin, raw_access.get_binary_start(), first_block, more_cb);
+                queue(std::move(first_block));
+                for (auto &block : all_blocks) {
+                    queue(std::move(block));
+                }
+            }
+        }
+        if (settings.info.show_basic || settings.info.all) {
+            std::unique_ptr<block> best_block = find_best_block(raw_access, bin);
+            if (best_block) queue(std::move(best_block));
+        }
+    } catch (std::exception &e) {
+        // info_guts will hit this again and report it; anything not queued is just verified there
+        DEBUG_LOG("Stopped gathering verifications: %s\n", e.what());
+    }
+    return verification;
+#else
+    return nullptr;
+#endif
+}
+
+void run_info_verifications(const vector<std::shared_ptr<info_verification>> &verifications) {
+#if HAS_MBEDTLS
+    vector<info_verification::job *> jobs;
+    for (const auto &v : verifications) {
+        if (!v) continue;
+        for (auto &j : v->jobs) {
+            if (!j.to_hash.empty()) jobs.push_back(&j);
+        }
+    }
+    if (jobs.empty()) return;
+    unsigned int num_threads = std::max(1u, std::min((unsigned int)jobs.size(), std::thread::hardware_concurrency()));
+    std::atomic<size_t> next_job(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next_job++) < jobs.size()) {
+            auto j = jobs[i];
+            try {
+                verify_block_data(j->to_hash, j->blk.get(), j->hash_verified, j->sig_verified);
+            } catch (...) {
+                j->error = std::current_exception();
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for (unsigned int i=1; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+        t.join();
+    }
+#endif
+}
+
 #if HAS_LIBUSB
-void info_guts(memory_access &raw_access, picoboot::connection *con) {
+void info_guts(memory_access &raw_access, picoboot::connection *con, info_verification *verification = nullptr) {
 #else
-void info_guts(memory_access &raw_access, void *con) {
+void info_guts(memory_access &raw_access, void *con, info_verification *verification = nullptr) {
 #endif
     // Use flash caching
     settings.use_flash_cache = true;
-    // Callback to pass to bintool, to get more bin data
-    get_more_bin_cb more_cb = [&raw_access](std::vector<uint8_t> &bin, uint32_t offset, uint32_t size) {
-        DEBUG_LOG("Now reading from %x size %x\n", offset, size);
-        bin = raw_access.read_vector<uint8_t>(offset, size, true);
-    };
+    get_more_bin_cb more_cb = info_more_cb(raw_access);
     try {
         struct group {
             explicit group(string name, bool enabled = true, int min_tab = 0) : name(std::move(name)), enabled(enabled), min_tab(min_tab) {}
@@ -3237,8 +3951,10 @@ void info_guts(memory_access &raw_access, void *con) {
             verified_t hash_verified = none;
             verified_t sig_verified = none;
         #if HAS_MBEDTLS
-            // Pass empty bin, which will be populated by more_cb if there is a signature/hash_value
-            verify_block({}, raw_access.get_binary_start(), raw_access.get_binary_start(), current_block, hash_verified, sig_verified, more_cb);
+            if (!verification || !verification->take(current_block, hash_verified, sig_verified)) {
+                // Pass empty bin, which will be populated by more_cb if there is a signature/hash_value
+                verify_block({}, raw_access.get_binary_start(), raw_access.get_binary_start(), current_block, hash_verified, sig_verified, more_cb);
+            }
         #endif
 
             // Addresses
@@ -3439,12 +4155,7 @@ void info_guts(memory_access &raw_access, void *con) {
         };
 
         // establish core groups and their order
-        if (!settings.info.show_basic && !settings.info.all && !settings.info.show_metadata && !settings.info.show_pins && !settings.info.show_device && !settings.info.show_debug && !settings.info.show_build) {
-            settings.info.show_basic = true;
-        }
-        if (settings.info.show_debug && !settings.info.show_device) {
-            settings.info.show_device = true;
-        }
+        set_default_info_groups();
         auto program_info = group("Program Information", settings.info.show_basic || settings.info.all);
         auto no_metadata_info = group("Metadata Blocks", false);
         vector<group> metadata_info;
@@ -3798,7 +4509,8 @@ void info_guts(memory_access &raw_access, void *con) {
             }
 
             try {
-                int32_t size_guess = guess_flash_size(raw_access);
+                const auto &geometry = con->get_flash_geometry();
+                int32_t size_guess = geometry.size ? geometry.size : guess_flash_size(raw_access);
                 if (size_guess > 0) {
                     info_pair("flash size", std::to_string(size_guess/1024) + "K");
                     if (model == rp2040) {
@@ -3807,6 +4519,21 @@ void info_guts(memory_access &raw_access, void *con) {
                         info_pair("flash id", hex_string(flash_id, 16, true, true));
                     }
                 }
+                if (geometry.jedec_id) {
+                    info_pair("flash jedec id", hex_string(geometry.jedec_id, 6, true, true));
+                }
+                if (geometry.erase_sizes) {
+                    string sizes;
+                    for (int i = 0; i < 32; i++) {
+                        if (!(geometry.erase_sizes & (1u << i))) continue;
+                        if (!sizes.empty()) sizes += ", ";
+                        sizes += i >= 10 ? std::to_string(1u << (i - 10)) + "K" : std::to_string(1u << i);
+                    }
+                    info_pair("flash erase sizes", sizes);
+                }
+                if (geometry.page_size) {
+                    info_pair("flash page size", std::to_string(geometry.page_size));
+                }
             } catch (picoboot::command_failure &e) {
                 if (e.get_code() == PICOBOOT_NOT_PERMITTED) {
                     info_pair("flash size", "not determined due to access permissions");
@@ -4104,6 +4831,24 @@ uint32_t get_family_id(uint8_t file_idx) {
     return family_id;
 }
 
+// As get_family_id, but using an already parsed image rather than reopening the file
+uint32_t get_family_id(parsed_image &image) {
+    uint32_t family_id = 0;
+    if (settings.family_id) {
+        family_id = settings.family_id;
+    } else if (image.get_type() == filetype::elf || image.get_type() == filetype::bin) {
+        if (!image.detected_family_id) {
+            auto file_access = image.access();
+            image.detected_family_id = get_access_family_id(file_access);
+        }
+        family_id = image.detected_family_id;
+    } else {
+        family_id = image.get_first_family_id();
+    }
+    DEBUG_LOG("Detected family ID %s\n", family_name(family_id).c_str());
+    return family_id;
+}
+
 #if HAS_LIBUSB
 std::shared_ptr<vector<tuple<uint32_t, uint32_t>>> get_partitions(picoboot::connection &con) {
     picoboot_memory_access raw_access(con);
@@ -4165,6 +4910,39 @@ std::shared_ptr<vector<tuple<uint32_t, uint32_t>>> get_partitions(picoboot::conn
 
     return std::make_shared<vector<tuple<uint32_t, uint32_t>>>(ret);
 }
+
+// Returns the other partition of the A/B pair that partition is in, or -1 if it is not in one
+int get_ab_partner(picoboot::connection &con, unsigned int partition) {
+    uint8_t loc_flags_id_buf[256];
+    uint32_t *loc_flags_id_buf_32 = (uint32_t *)loc_flags_id_buf;
+    picoboot_get_info_cmd cmd;
+    cmd.bType = PICOBOOT_GET_INFO_PARTTION_TABLE;
+    cmd.dParams[0] = PT_INFO_PT_INFO | PT_INFO_PARTITION_LOCATION_AND_FLAGS | PT_INFO_PARTITION_ID;
+    con.get_info(&cmd, loc_flags_id_buf, sizeof(loc_flags_id_buf));
+    unsigned int lfi_pos = 2;
+    unsigned int partition_count = loc_flags_id_buf[lfi_pos * 4];
+    lfi_pos += 3;
+    // for each partition, the A partition it is the B partition of, if any
+    vector<int> a_partition;
+    for (unsigned int i = 0; i < partition_count; i++) {
+        lfi_pos++;
+        uint32_t flags_and_permissions = loc_flags_id_buf_32[lfi_pos++];
+        if (flags_and_permissions & PICOBIN_PARTITION_FLAGS_HAS_ID_BITS) {
+            lfi_pos += 2;
+        }
+        if ((flags_and_permissions & PICOBIN_PARTITION_FLAGS_LINK_TYPE_BITS) ==
+            PICOBIN_PARTITION_FLAGS_LINK_TYPE_AS_BITS(A_PARTITION)) {
+            a_partition.push_back((flags_and_permissions & PICOBIN_PARTITION_FLAGS_LINK_VALUE_BITS) >> PICOBIN_PARTITION_FLAGS_LINK_VALUE_LSB);
+        } else {
+            a_partition.push_back(-1);
+        }
+    }
+    if (partition >= a_partition.size()) return -1;
+    if (a_partition[partition] >= 0) return a_partition[partition];
+    auto b = std::find(a_partition.begin(), a_partition.end(), (int)partition);
+    return b == a_partition.end() ? -1 : b - a_partition.begin();
+}
+
 #endif
 
 bool config_command::execute(device_map &devices) {
@@ -4220,41 +4998,198 @@ bool config_command::execute(device_map &devices) {
     return false;
 }
 
-bool info_command::execute(device_map &devices) {
-    fos.first_column(0); fos.hanging_indent(0);
-    if (!settings.filenames[0].empty()) {
-        uint32_t next_id = 0;
-        auto access = get_file_memory_access(0, false, &next_id);
-        uint32_t id = 0;
-        id = get_family_id(0);
-        if (id == RP2040_FAMILY_ID) {
-            access.set_model(rp2040);
-        } else if (id >= RP2350_ARM_S_FAMILY_ID && id <= RP2350_ARM_NS_FAMILY_ID) {
-            access.set_model(rp2350);
+// Display the information for the file settings.filenames[0]
+static void info_file() {
+    parsed_image image(0);
+    auto access = image.access();
+    uint32_t id = get_family_id(image);
+    if (id == RP2040_FAMILY_ID) {
+        access.set_model(rp2040);
+    } else if (id >= RP2350_ARM_S_FAMILY_ID && id <= RP2350_ARM_NS_FAMILY_ID) {
+        access.set_model(rp2350);
+    }
+    if (image.get_next_family_id(0)) {
+        // Gather the hash/signature checks for every family first, so they can run together
+        vector<uint32_t> family_ids;
+        vector<iostream_memory_access> accesses;
+        vector<std::shared_ptr<info_verification>> verifications;
+        uint32_t next_id = id;
+        while (next_id) {
+            family_ids.push_back(next_id);
+            accesses.push_back(image.access(next_id));
+            verifications.push_back(prepare_info_verification(accesses.back()));
+            next_id = image.get_next_family_id(next_id);
+        }
+        run_info_verifications(verifications);
+        for (size_t i=0; i < family_ids.size(); i++) {
+            next_id = family_ids[i];
+            fos.first_column(0); fos.hanging_indent(0);
+            std::stringstream s;
+            s << "File " << settings.filenames[0] << " family ID " << family_name(next_id) << ":";
+            if (next_id != id) {
+                string dashes;
+                std::generate_n(std::back_inserter(dashes), s.str().length() + 1, [] { return '-'; });
+                fos << "\n" << dashes << "\n";
+            }
+            fos << s.str() << "\n\n";
+            info_guts(accesses[i], nullptr, verifications[i].get());
         }
-        if (next_id) {
-            next_id = id;
-            while (next_id) {
-                fos.first_column(0); fos.hanging_indent(0);
-                std::stringstream s;
-                s << "File " << settings.filenames[0] << " family ID " << family_name(next_id) << ":";
-                if (next_id != id) {
-                    string dashes;
-                    std::generate_n(std::back_inserter(dashes), s.str().length() + 1, [] { return '-'; });
-                    fos << "\n" << dashes << "\n";
-                }
-                fos << s.str() << "\n\n";
-                auto tmp_access = get_file_memory_access(0, false, &next_id);
-                info_guts(tmp_access, nullptr);
+    } else {
+        if (get_file_type() == filetype::uf2) {
+            fos << "File " << settings.filenames[0] << " family ID " << family_name(id) << ":\n\n";
+        } else {
+            fos << "File " << settings.filenames[0] << ":\n\n";
+        }
+        info_guts(access, nullptr);
+    }
+}
+
+// A file to process for --scan, or a path that could not be read, which is reported as a failure in its place
+struct scan_file {
+    string path;
+    string error;
+};
+
+// Expand the --scan paths into the list of files to process; directories are searched recursively (in name
+// order, so the output is repeatable) for ELF, UF2 and BIN files, and - reads one path per line from stdin
+static void add_scan_path(const string &path, vector<scan_file> &files, bool explicit_path) {
+    auto add_error = [&](const char *what) {
+        files.push_back({path, string(what) + " '" + path + "': " + strerror(errno)});
+    };
+    struct stat st;
+#if defined(__unix__) || defined(__APPLE__)
+    // don't follow links to directories, as they could loop
+    if (lstat(path.c_str(), &st)) return add_error("Could not open");
+    if (S_ISLNK(st.st_mode) && (stat(path.c_str(), &st) || (st.st_mode & S_IFMT) == S_IFDIR)) return;
+#else
+    if (stat(path.c_str(), &st)) return add_error("Could not open");
+#endif
+    if ((st.st_mode & S_IFMT) != S_IFDIR) {
+        auto low = lowercase(path);
+        auto has_ext = [&](const string &ext) {
+            return low.size() >= ext.size() && low.compare(low.size() - ext.size(), ext.size(), ext) == 0;
+        };
+        if (explicit_path || has_ext(".elf") || has_ext(".uf2") || has_ext(".bin")) files.push_back({path, ""});
+        return;
+    }
+    vector<string> names;
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE) {
+        // even an empty directory lists . and ..
+        files.push_back({path, "Could not open directory '" + path + "': error " + std::to_string(GetLastError())});
+        return;
+    }
+    do {
+        names.emplace_back(data.cFileName);
+    } while (FindNextFileA(h, &data));
+    FindClose(h);
+    const char *sep = "\\";
+#else
+    DIR *dir = opendir(path.c_str());
+    if (!dir) return add_error("Could not open directory");
+    while (struct dirent *ent = readdir(dir)) {
+        names.emplace_back(ent->d_name);
+    }
+    closedir(dir);
+    const char *sep = "/";
+#endif
+    std::sort(names.begin(), names.end());
+    for (const auto &name : names) {
+        if (name == "." || name == "..") continue;
+        add_scan_path(path.back() == sep[0] ? path + name : path + sep + name, files, false);
+    }
+}
+
+// Runs info_file for each file on a pool of threads, each with its own copy of the settings and its own output,
+// and prints each file's output as soon as it and all the files before it are done
+static bool info_scan() {
+    vector<scan_file> files;
+    for (const auto &path : settings.info.scan_paths) {
+        if (path == "-") {
+            string line;
+            while (std::getline(std::cin, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) add_scan_path(line, files, true);
             }
         } else {
-            if (get_file_type() == filetype::uf2) {
-                fos << "File " << settings.filenames[0] << " family ID " << family_name(id) << ":\n\n";
-            } else {
-                fos << "File " << settings.filenames[0] << ":\n\n";
+            add_scan_path(path, files, true);
+        }
+    }
+
+    struct job {
+        string output;
+        bool failed = false;
+        bool done = false;
+    };
+    vector<job> jobs(files.size());
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> next_job(0);
+    const _settings base_settings = settings;
+    auto worker = [&]() {
+        settings = base_settings;
+        settings.map_files = true;
+        size_t i;
+        while ((i = next_job++) < jobs.size()) {
+            std::stringstream out;
+            fos_ptr = std::make_shared<clipp::formatting_ostream<std::ostream>>(out);
+            settings.filenames[0] = files[i].path;
+            settings.use_flash_cache = false;
+            selected_model = unknown;
+            bool failed = false;
+            try {
+                if (!files[i].error.empty()) fail(ERROR_READ_FAILED, files[i].error);
+                info_file();
+            } catch (std::exception &e) {
+                fos.first_column(0); fos.hanging_indent(0);
+                fos << "File " << files[i].path << ":\n\nERROR: " << e.what() << "\n";
+                failed = true;
             }
-            info_guts(access, nullptr);
+            fos.flush();
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs[i].output = out.str();
+            jobs[i].failed = failed;
+            jobs[i].done = true;
+            cv.notify_all();
         }
+    };
+    unsigned int num_threads = settings.info.jobs > 0 ? settings.info.jobs : std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::max(1u, std::min(num_threads, (unsigned int)jobs.size()));
+    vector<std::thread> threads;
+    for (unsigned int i=0; i < num_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    int failures = 0;
+    for (size_t i=0; i < jobs.size(); i++) {
+        string output;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] { return jobs[i].done; });
+            output.swap(jobs[i].output);
+        }
+        if (i) fos << "\n";
+        fos << output;
+        fos.flush();
+        if (jobs[i].failed) failures++;
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    if (failures) {
+        fail(ERROR_READ_FAILED, "Could not read %d of %d files", failures, (int)files.size());
+    }
+    return false;
+}
+
+bool info_command::execute(device_map &devices) {
+    fos.first_column(0); fos.hanging_indent(0);
+    if (!settings.info.scan_paths.empty()) {
+        return info_scan();
+    }
+    if (!settings.filenames[0].empty()) {
+        info_file();
         return false;
     }
 #if HAS_LIBUSB
@@ -4298,21 +5233,27 @@ bool info_command::execute(device_map &devices) {
                     for (auto range : *partitions) {
                         starts.push_back(std::get<0>(range));
                     }
+                    vector<std::pair<string, uint32_t>> images;
                     if (has_bootloader && std::none_of(starts.cbegin(), starts.cend(), [](int i) { return i == 0; })) {
                         // Print bootloader info, only if bootloader is present and not in a partition
-                        fos.first_column(0); fos.hanging_indent(0);
-                        fos << "\nBootloader\n";
-                        fos.first_column(1);
-                        partition_memory_access part_access(access, 0);
-                        info_guts(part_access, &connection);
+                        images.emplace_back("Bootloader", 0);
                     }
                     for (unsigned int i=0; i < starts.size(); i++) {
-                        uint32_t start = starts[i];
+                        images.emplace_back("Partition " + std::to_string(i), starts[i]);
+                    }
+                    // Read everything needed for the hash/signature checks first, then run them all together
+                    vector<std::shared_ptr<info_verification>> verifications;
+                    for (const auto &image : images) {
+                        partition_memory_access part_access(access, image.second);
+                        verifications.push_back(prepare_info_verification(part_access));
+                    }
+                    run_info_verifications(verifications);
+                    for (size_t i=0; i < images.size(); i++) {
                         fos.first_column(0); fos.hanging_indent(0);
-                        fos << "\nPartition " << i << "\n";
+                        fos << "\n" << images[i].first << "\n";
                         fos.first_column(1);
-                        partition_memory_access part_access(access, start);
-                        info_guts(part_access, &connection);
+                        partition_memory_access part_access(access, images[i].second);
+                        info_guts(part_access, &connection, verifications[i].get());
                     }
                 }
                 if (device || debug) {
@@ -4421,6 +5362,304 @@ vector<range> get_coalesced_ranges(iostream_memory_access &file_access, model_t
     return ranges;
 }
 
+// Reads RP2040 flash through a helper exec'd on the device, which compresses each batch of 4K sectors into SRAM to
+// be read back. Each sector starts with a tag byte: 0 and 1 are a sector that is all 0xff (erased) or all 0x00, with
+// no data following; 2 is followed by a 16 bit little-endian length and the sector compressed in the format of
+// helper_compress, with matches only within the sector; and 3 is followed by the sector uncompressed
+struct compressed_flash_reader {
+    static constexpr uint32_t code_addr = SRAM_START + 0x30000;
+    static constexpr uint32_t params_addr = code_addr + 0x200;
+    static constexpr uint32_t output_addr = SRAM_START;
+    static constexpr uint32_t table_addr = SRAM_START + 0x20000;
+    static constexpr uint32_t sectors_per_batch = 16;
+
+    compressed_flash_reader(picoboot::connection &con, memory_access &raw_access) : con(con) {
+        // params: flash address, sector count, output address, hash table address, output length (written by the helper).
+        // Matches are found through a hash of the next 3 bytes into a table of flash addresses, which is not cleared,
+        // as only entries inside the current sector and before the current position are used. The XIP cache is flushed
+        // first, as it may hold data from before flash was last written
+        std::vector<uint32_t> program = {
+                0x484db5f0, // dump: push {r4-r7, lr};  ldr r0, xip_flush
+                0x60012101, // movs r1, #1;  str r1, [r0]
+                0x46406801, // ldr r1, [r0];  mov r0, r8
+                0xb4034649, // mov r1, r9;  push {r0, r1}
+                0x484bb082, // sub sp, #8;  ldr r0, params
+                0x68416807, // ldr r7, [r0, #0];  ldr r1, [r0, #4]
+                0x68c26885, // ldr r5, [r0, #8];  ldr r2, [r0, #12]
+                0x91004691, // mov r9, r2;  str r1, [sp, #0]
+                0x39019900, // block_loop: ldr r1, [sp, #0];  subs r1, #1
+                0x9100d46f, // bmi done;  str r1, [sp, #0]
+                0x1c416838, // ldr r0, [r7, #0];  adds r1, r0, #1
+                0x2800d001, // beq uniform;  cmp r0, #0
+                0x2204d10c, // bne not_uniform;  uniform: movs r2, #4
+                0x031b2301, // movs r3, #1;  lsls r3, r3, #12
+                0x428158b9, // uniform_loop: ldr r1, [r7, r2];  cmp r1, r0
+                0x3204d106, // bne not_uniform;  adds r2, #4
+                0xd1f9429a, // cmp r2, r3;  bne uniform_loop
+                0x70283001, // adds r0, #1;  strb r0, [r5]
+                0xe0583501, // adds r5, #1;  b next_block
+                0x70282002, // not_uniform: movs r0, #2;  strb r0, [r5]
+                0x350346a8, // mov r8, r5;  adds r5, #3
+                0x003e003c, // movs r4, r7;  movs r6, r7
+                0x03002001, // movs r0, #1;  lsls r0, r0, #12
+                0x900119c0, // adds r0, r0, r7;  str r0, [sp, #4]
+                0x38029801, // lz_loop: ldr r0, [sp, #4];  subs r0, #2
+                0xd2314284, // cmp r4, r0;  bhs lz_end
+                0x78617820, // ldrb r0, [r4, #0];  ldrb r1, [r4, #1]
+                0x43080209, // lsls r1, r1, #8;  orrs r0, r1
+                0x040978a1, // ldrb r1, [r4, #2];  lsls r1, r1, #16
+                0x49314308, // orrs r0, r1;  ldr r1, hash_mul
+                0x0d004348, // muls r0, r1;  lsrs r0, r0, #20
+                0x46490080, // lsls r0, r0, #2;  mov r1, r9
+                0x500c580a, // ldr r2, [r1, r0];  str r4, [r1, r0]
+                0xd31f42ba, // cmp r2, r7;  blo no_match
+                0xd21d42a2, // cmp r2, r4;  bhs no_match
+                0x1b009801, // ldr r0, [sp, #4];  subs r0, r0, r4
+                0xd9002882, // cmp r0, #130;  bls limit_ok
+                0x46842082, // movs r0, #130;  limit_ok: mov r12, r0
+                0x45632300, // movs r3, #0;  len_loop: cmp r3, r12
+                0x5cd0d005, // beq len_done;  ldrb r0, [r2, r3]
+                0x42885ce1, // ldrb r1, [r4, r3];  cmp r0, r1
+                0x3301d101, // bne len_done;  adds r3, #1
+                0x2b03e7f7, // b len_loop;  len_done: cmp r3, #3
+                0x1aa2d30c, // blo no_match;  subs r2, r4, r2
+                0xf832f000, // bl flush
+                0x307d0018, // movs r0, r3;  adds r0, #0x7d
+                0x706a7028, // strb r0, [r5];  strb r2, [r5, #1]
+                0x70aa0a12, // lsrs r2, r2, #8;  strb r2, [r5, #2]
+                0x18e43503, // adds r5, #3;  adds r4, r4, r3
+                0xe7cb0026, // movs r6, r4;  b lz_loop
+                0xe7c93401, // no_match: adds r4, #1;  b lz_loop
+                0xbf009c01, // lz_end: ldr r4, [sp, #4];  nop
+                0xf822f000, // bl flush
+                0x1a294640, // mov r0, r8;  subs r1, r5, r0
+                0x22013903, // subs r1, #3;  movs r2, #1
+                0x42910312, // lsls r2, r2, #12;  cmp r1, r2
+                0x7041d203, // bhs raw;  strb r1, [r0, #1]
+                0x70810a09, // lsrs r1, r1, #8;  strb r1, [r0, #2]
+                0x2103e009, // b next_block;  raw: movs r1, #3
+                0x1c457001, // strb r1, [r0];  adds r5, r0, #1
+                0x5cf92300, // movs r3, #0;  raw_loop: ldrb r1, [r7, r3]
+                0x330154e9, // strb r1, [r5, r3];  adds r3, #1
+                0xd1fa4293, // cmp r3, r2;  bne raw_loop
+                0x200118ad, // adds r5, r5, r2;  next_block: movs r0, #1
+                0x183f0300, // lsls r0, r0, #12;  adds r7, r7, r0
+                0x480ee78c, // b block_loop;  done: ldr r0, params
+                0x1a696881, // ldr r1, [r0, #8];  subs r1, r5, r1
+                0xb0026101, // str r1, [r0, #16];  add sp, #8
+                0x4680bc03, // pop {r0, r1};  mov r8, r0
+                0xbdf04689, // mov r9, r1;  pop {r4-r7, pc}
+                0xd00c1ba0, // flush: subs r0, r4, r6;  beq flush_done
+                0xd9002880, // cmp r0, #128;  bls flush_run
+                0x1e412080, // movs r0, #128;  flush_run: subs r1, r0, #1
+                0x35017029, // strb r1, [r5];  adds r5, #1
+                0x70297831, // flush_byte: ldrb r1, [r6];  strb r1, [r5]
+                0x35013601, // adds r6, #1;  adds r5, #1
+                0xd1f93801, // subs r0, #1;  bne flush_byte
+                0x4770e7f0, // b flush;  flush_done: bx lr
+                0x14000004, // xip_flush (XIP_CTRL FLUSH)
+                0x9e3779b1, // hash_mul
+                params_addr,
+        };
+        assert(program.size() * 4 <= params_addr - code_addr);
+        raw_access.write_vector(code_addr, program);
+    }
+
+    // Read len bytes of flash at the sector aligned address
+    void read(uint32_t address, uint32_t len, vector<uint8_t> &data) {
+        assert(!(address & (FLASH_SECTOR_ERASE_SIZE - 1)) && !(len & (FLASH_SECTOR_ERASE_SIZE - 1)));
+        data.resize(len);
+        // the helper reads flash through XIP
+        con.enter_cmd_xip();
+        uint8_t *out = data.data();
+        vector<uint8_t> compressed;
+        while (len) {
+            uint32_t sectors = std::min(len / FLASH_SECTOR_ERASE_SIZE, (uint32_t)sectors_per_batch);
+            uint32_t params[5] = {address, sectors, output_addr, table_addr, 0};
+            con.write(params_addr, (uint8_t *)params, sizeof(params));
+            con.exec(code_addr);
+            uint32_t compressed_len;
+            con.read(params_addr + 16, (uint8_t *)&compressed_len, sizeof(compressed_len));
+            if (compressed_len > sectors * (FLASH_SECTOR_ERASE_SIZE + 1)) {
+                fail(ERROR_READ_FAILED, "The flash read helper returned an invalid length for 0x%08x", address);
+            }
+            compressed.resize(compressed_len);
+            con.read(output_addr, compressed.data(), compressed_len);
+            decompress(address, compressed, sectors, out);
+            wire_bytes += compressed_len + sizeof(params) + sizeof(compressed_len);
+            logical_bytes += sectors * FLASH_SECTOR_ERASE_SIZE;
+            address += sectors * FLASH_SECTOR_ERASE_SIZE;
+            out += sectors * FLASH_SECTOR_ERASE_SIZE;
+            len -= sectors * FLASH_SECTOR_ERASE_SIZE;
+        }
+    }
+
+    // Bytes read over USB for flash data (including the helper parameters), and the bytes of flash data they carried
+    uint64_t wire_bytes = 0;
+    uint64_t logical_bytes = 0;
+
+private:
+    static void decompress(uint32_t address, const vector<uint8_t> &in, uint32_t sectors, uint8_t *out) {
+        auto bad_data = [&]() {
+            fail(ERROR_READ_FAILED, "The flash read helper returned invalid data for 0x%08x", address);
+        };
+        uint32_t pos = 0;
+        for (uint32_t s = 0; s < sectors; s++, out += FLASH_SECTOR_ERASE_SIZE) {
+            if (pos >= in.size()) bad_data();
+            uint8_t tag = in[pos++];
+            if (tag == 0 || tag == 1) {
+                memset(out, tag ? 0 : 0xff, FLASH_SECTOR_ERASE_SIZE);
+            } else if (tag == 3) {
+                if (in.size() - pos < FLASH_SECTOR_ERASE_SIZE) bad_data();
+                memcpy(out, in.data() + pos, FLASH_SECTOR_ERASE_SIZE);
+                pos += FLASH_SECTOR_ERASE_SIZE;
+            } else if (tag == 2) {
+                if (in.size() - pos < 2) bad_data();
+                uint32_t end = pos + 2 + (in[pos] | (in[pos + 1] << 8));
+                pos += 2;
+                if (end > in.size()) bad_data();
+                uint32_t produced = 0;
+                while (pos < end) {
+                    uint8_t c = in[pos++];
+                    if (c < 0x80) {
+                        uint32_t n = c + 1;
+                        if (end - pos < n || produced + n > FLASH_SECTOR_ERASE_SIZE) bad_data();
+                        memcpy(out + produced, in.data() + pos, n);
+                        pos += n;
+                        produced += n;
+                    } else {
+                        uint32_t n = (c & 0x7f) + 3;
+                        if (end - pos < 2) bad_data();
+                        uint32_t distance = in[pos] | (in[pos + 1] << 8);
+                        pos += 2;
+                        if (!distance || distance > produced || produced + n > FLASH_SECTOR_ERASE_SIZE) bad_data();
+                        // byte by byte, as the copy may overlap what it produces
+                        for (uint32_t i = 0; i < n; i++, produced++) {
+                            out[produced] = out[produced - distance];
+                        }
+                    }
+                }
+                if (produced != FLASH_SECTOR_ERASE_SIZE) bad_data();
+            } else {
+                bad_data();
+            }
+        }
+        if (pos != in.size()) bad_data();
+    }
+
+    picoboot::connection &con;
+};
+
+// Which flash sectors in a range are erased (all 0xff), found by a helper exec'd on RP2040 devices, so that erased
+// sectors don't need to be read over USB, or erased again
+struct blank_sector_map {
+    static constexpr uint32_t code_addr = SRAM_START + 0x31000;
+    static constexpr uint32_t params_addr = code_addr + 0x100;
+    static constexpr uint32_t sectors_per_batch = 256;
+
+    // SRAM overwritten by the helper
+    static range sram_used() {
+        return range(code_addr, params_addr + 8 + sectors_per_batch / 8);
+    }
+
+    // Returns nullptr if the helper can't be used on the device
+    static std::unique_ptr<blank_sector_map> create(picoboot::connection &con, memory_access &raw_access, range r) {
+        if (get_model(raw_access) != rp2040 || r.empty()) return nullptr;
+        return std::unique_ptr<blank_sector_map>(new blank_sector_map(con, raw_access, r));
+    }
+
+    // Whether the sector containing address is erased
+    bool is_blank(uint32_t address) const {
+        if (address < from || address >= to) return false;
+        return blank[(address - from) / FLASH_SECTOR_ERASE_SIZE];
+    }
+
+    uint32_t blank_count() const {
+        return std::count(blank.begin(), blank.end(), true);
+    }
+
+    uint32_t sector_count() const {
+        return blank.size();
+    }
+
+    // Read len bytes at address into data, using read_sectors for each run of sectors that is not erased
+    void read(uint32_t address, uint32_t len, vector<uint8_t> &data,
+              const std::function<void(uint32_t address, uint32_t len, vector<uint8_t> &data)> &read_sectors) const {
+        data.resize(len);
+        uint8_t *out = data.data();
+        uint32_t end = address + len;
+        vector<uint8_t> buf;
+        while (address < end) {
+            bool run_blank = is_blank(address);
+            uint32_t run_end = std::min((address & ~(FLASH_SECTOR_ERASE_SIZE - 1)) + FLASH_SECTOR_ERASE_SIZE, end);
+            while (run_end < end && is_blank(run_end) == run_blank) {
+                run_end = std::min(run_end + FLASH_SECTOR_ERASE_SIZE, end);
+            }
+            if (run_blank) {
+                memset(out, 0xff, run_end - address);
+            } else {
+                read_sectors(address, run_end - address, buf);
+                assert(buf.size() == run_end - address);
+                memcpy(out, buf.data(), buf.size());
+            }
+            out += run_end - address;
+            address = run_end;
+        }
+    }
+
+private:
+    blank_sector_map(picoboot::connection &con, memory_access &raw_access, range r) {
+        from = r.from & ~(FLASH_SECTOR_ERASE_SIZE - 1);
+        to = (r.to + FLASH_SECTOR_ERASE_SIZE - 1) & ~(FLASH_SECTOR_ERASE_SIZE - 1);
+        // params: flash address, sector count, then the bitmap of erased sectors, which is cleared by the host. The
+        // XIP cache is flushed first, as it may hold data from before flash was last written
+        std::vector<uint32_t> program = {
+                0x4811b5f0, // blank_check: push {r4-r7, lr};  ldr r0, xip_flush
+                0x60012101, // movs r1, #1;  str r1, [r0]
+                0x48106801, // ldr r1, [r0];  ldr r0, params
+                0x68426801, // ldr r1, [r0, #0];  ldr r2, [r0, #4]
+                0x33080003, // movs r3, r0;  adds r3, #8
+                0x42942400, // movs r4, #0;  sector_loop: cmp r4, r2
+                0x2501d014, // beq done;  movs r5, #1
+                0x186d032d, // lsls r5, r5, #12;  adds r5, r5, r1
+                0x3601680e, // word_loop: ldr r6, [r1];  adds r6, #1
+                0x3104d10b, // bne not_blank;  adds r1, #4
+                0xd1f942a9, // cmp r1, r5;  bne word_loop
+                0x5d9808e6, // lsrs r6, r4, #3;  ldrb r0, [r3, r6]
+                0x40252507, // movs r5, #7;  ands r5, r4
+                0x40af2701, // movs r7, #1;  lsls r7, r5
+                0x55984338, // orrs r0, r7;  strb r0, [r3, r6]
+                0x0029e000, // b next_sector;  not_blank: movs r1, r5
+                0xe7e83401, // next_sector: adds r4, #1;  b sector_loop
+                0x46c0bdf0, // done: pop {r4-r7, pc};  (padding)
+                0x14000004, // xip_flush (XIP_CTRL FLUSH)
+                params_addr,
+        };
+        assert(program.size() * 4 <= params_addr - code_addr);
+        raw_access.write_vector(code_addr, program);
+        // the helper reads flash through XIP
+        con.enter_cmd_xip();
+        blank.resize((to - from) / FLASH_SECTOR_ERASE_SIZE);
+        for (uint32_t first = 0; first < blank.size(); first += sectors_per_batch) {
+            uint32_t sectors = std::min((uint32_t)blank.size() - first, (uint32_t)sectors_per_batch);
+            vector<uint8_t> params(8 + (sectors + 7) / 8);
+            *(uint32_t *)params.data() = from + first * FLASH_SECTOR_ERASE_SIZE;
+            *(uint32_t *)(params.data() + 4) = sectors;
+            con.write(params_addr, params.data(), params.size());
+            con.exec(code_addr);
+            con.read(params_addr + 8, params.data() + 8, params.size() - 8);
+            for (uint32_t i = 0; i < sectors; i++) {
+                blank[first + i] = params[8 + i / 8] & (1u << (i & 7));
+            }
+        }
+        con.exit_xip();
+    }
+
+    uint32_t from;
+    uint32_t to;
+    vector<bool> blank;
+};
+
 bool save_command::execute(device_map &devices) {
     auto con = get_single_bootsel_device_connection(devices);
     picoboot_memory_access raw_access(con);
@@ -4469,7 +5708,7 @@ bool save_command::execute(device_map &devices) {
             }
         }
     } else {
-        end = FLASH_START + guess_flash_size(raw_access);
+        end = FLASH_START + get_flash_size(con, raw_access);
         if (end <= FLASH_START) {
             fail(ERROR_NOT_POSSIBLE, "Cannot determine the flash size, so cannot save the entirety of flash, try --range.");
         }
@@ -4484,20 +5723,23 @@ bool save_command::execute(device_map &devices) {
     uint32_t size = end - start;
     uint32_t chunk_size = calculate_chunk_size(size);
 
-    std::function<void(FILE *out, const uint8_t *buffer, unsigned int size, unsigned int offset)> writer256 = [](FILE *out, const uint8_t *buffer, unsigned int size, unsigned int offset) { assert(false); };
+    std::unique_ptr<blank_sector_map> blank_map;
+    if (settings.save.sparse && t1 == flash) {
+        blank_map = blank_sector_map::create(con, raw_access, range(start, end));
+        if (!blank_map) {
+            std::cout << "Saving erased sectors, as they can only be found on RP2040\n";
+        }
+    }
+    save_writer::page_writer writer256 = [](save_writer &out, const uint8_t *buffer, unsigned int size, unsigned int offset) { assert(false); };
     uf2_block block;
     memset(&block, 0, sizeof(block));
+    uint32_t block_no = 0;
     switch (get_file_type()) {
         case filetype::bin:
 //            if (start != FLASH_START) {
 //                fail(ERROR_ARGS, "range must start at 0x%08x for saving as a BIN file", FLASH_START);
 //            }
-            writer256 = [](FILE *out, const uint8_t *buffer, unsigned int actual_size, unsigned int offset) {
-                fseek(out, offset, SEEK_SET);
-                if (1 != fwrite(buffer, actual_size, 1, out)) {
-                    fail_write_error();
-                }
-            };
+            writer256 = bin_page_writer(size, settings.save.sparse);
             break;
         case filetype::elf:
             fail(ERROR_ARGS, "Save to ELF file is not supported");
@@ -4508,44 +5750,80 @@ bool save_command::execute(device_map &devices) {
             block.flags = UF2_FLAG_FAMILY_ID_PRESENT;
             block.payload_size = PAGE_SIZE;
             block.num_blocks = (size + PAGE_SIZE - 1)/PAGE_SIZE;
+            if (blank_map) {
+                // blocks in erased sectors are left out
+                for (uint32_t addr = start; addr < end; addr += PAGE_SIZE) {
+                    if (blank_map->is_blank(addr)) block.num_blocks--;
+                }
+            }
             block.file_size = settings.family_id ? settings.family_id : get_access_family_id(raw_access);
             block.magic_end = UF2_MAGIC_END;
-            writer256 = [&](FILE *out, const uint8_t *buffer, unsigned int size, unsigned int offset) {
+            writer256 = [&](save_writer &out, const uint8_t *buffer, unsigned int size, unsigned int offset) {
                 static_assert(512 == sizeof(block), "");
                 block.target_addr = start + offset;
-                block.block_no = offset / PAGE_SIZE;
+                if (blank_map && blank_map->is_blank(block.target_addr)) return;
+                block.block_no = block_no++;
                 assert(size <= PAGE_SIZE);
                 memcpy(block.data, buffer, size);
                 if (size < PAGE_SIZE) memset(block.data + size, 0, PAGE_SIZE - size);
-                if (1 != fwrite(&block, sizeof(block), 1, out)) {
-                    fail_write_error();
-                }
+                out.write(block.block_no * sizeof(block), &block, sizeof(block));
             };
             break;
         default:
             throw command_failure(-1, "Unsupported output file type");
     }
+    std::unique_ptr<compressed_flash_reader> reader;
+    if (settings.save.compress) {
+        if (model != rp2040) {
+            std::cout << "Reading uncompressed, as the flash read helper is only supported on RP2040\n";
+        } else if (t1 == flash) {
+            reader = std::unique_ptr<compressed_flash_reader>(new compressed_flash_reader(con, raw_access));
+        }
+    }
+    auto read_device = [&](uint32_t addr, uint32_t len, vector<uint8_t> &data) {
+        uint32_t sectors_size = len & ~(FLASH_SECTOR_ERASE_SIZE - 1);
+        if (reader && !(addr & (FLASH_SECTOR_ERASE_SIZE - 1)) && sectors_size) {
+            // the helper reads whole sectors, so any partial sector at the end is read directly
+            reader->read(addr, sectors_size, data);
+            if (sectors_size < len) {
+                vector<uint8_t> tail;
+                raw_access.read_into_vector(addr + sectors_size, len - sectors_size, tail);
+                data.insert(data.end(), tail.begin(), tail.end());
+            }
+        } else {
+            raw_access.read_into_vector(addr, len, data);
+        }
+    };
     FILE *out = fopen(settings.filenames[0].c_str(), "wb");
     if (out) {
         try {
-            vector<uint8_t> buf;
             {
                 progress_bar bar("Saving file: ");
+                // the device is read here while the previous chunks are written out by the writer thread
+                save_writer writer(out, writer256);
                 for (uint32_t addr = start; addr < end; addr += chunk_size) {
                     bar.progress(addr-start, end-start);
                     uint32_t this_chunk_size = std::min(chunk_size, end - addr);
-                    raw_access.read_into_vector(addr, this_chunk_size, buf);
-                    uint32_t remaining_size = this_chunk_size;
-                    while (remaining_size) {
-                        uint32_t this_size = std::min(PAGE_SIZE, remaining_size);
-                        writer256(out, buf.data() + (this_chunk_size - remaining_size), this_size, addr - start + (this_chunk_size - remaining_size));
-                        remaining_size -= this_size;
+                    vector<uint8_t> buf;
+                    if (blank_map) {
+                        blank_map->read(addr, this_chunk_size, buf, read_device);
+                    } else {
+                        read_device(addr, this_chunk_size, buf);
                     }
+                    writer.add(addr - start, std::move(buf));
                 }
+                writer.finish();
                 bar.progress(100);
             }
             fseek(out, 0, SEEK_END);
             std::cout << "Wrote " << ftell(out) << " bytes to " << settings.filenames[0].c_str() << "\n";
+            if (reader && reader->logical_bytes) {
+                std::cout << "  Read " << reader->wire_bytes << " bytes over USB for " << reader->logical_bytes << " bytes of flash data ("
+                          << std::fixed << std::setprecision(1) << (double)reader->logical_bytes / reader->wire_bytes << "x)\n";
+            }
+            if (blank_map) {
+                std::cout << "  " << blank_map->blank_count() << " of " << blank_map->sector_count() << " flash sectors were erased, and were not read\n";
+            }
             fclose(out);
         } catch (std::exception &) {
             fclose(out);
@@ -4572,7 +5850,13 @@ bool save_command::execute(device_map &devices) {
                     // mean that the verification will fail if those holes are not filled with zeros
                     // on the device
                     file_access.read_into_vector(base, this_batch, file_buf, true);
-                    raw_access.read_into_vector(base, this_batch, device_buf);
+                    if (blank_map) {
+                        blank_map->read(base, this_batch, device_buf, [&](uint32_t addr, uint32_t len, vector<uint8_t> &data) {
+                            raw_access.read_into_vector(addr, len, data);
+                        });
+                    } else {
+                        raw_access.read_into_vector(base, this_batch, device_buf);
+                    }
                     assert(file_buf.size() == device_buf.size());
                     for (unsigned int i = 0; i < this_batch; i++) {
                         if (file_buf[i] != device_buf[i]) {
@@ -4641,7 +5925,7 @@ bool erase_command::execute(device_map &devices) {
             fail(ERROR_ARGS, "Erase range is invalid/empty");
         }
     } else {
-        end = FLASH_START + guess_flash_size(raw_access);
+        end = FLASH_START + get_flash_size(con, raw_access);
         if (end <= FLASH_START) {
             fail(ERROR_NOT_POSSIBLE, "Cannot determine the flash size, so cannot erase the entirety of flash, try --range.");
         }
@@ -4655,15 +5939,38 @@ bool erase_command::execute(device_map &devices) {
     }
     uint32_t size = end - start;
 
+    auto blank_map = blank_sector_map::create(con, raw_access, range(start, end));
     {
         progress_bar bar("Erasing: ");
-        for (uint32_t addr = start; addr < end; addr += FLASH_SECTOR_ERASE_SIZE) {
-            bar.progress(addr-start, end-start);
-            con.flash_erase(addr, FLASH_SECTOR_ERASE_SIZE);
+        if (blank_map) {
+            // skip sectors which are already erased, and erase each run of the others with one command
+            for (uint32_t addr = start; addr < end;) {
+                if (blank_map->is_blank(addr)) {
+                    addr += FLASH_SECTOR_ERASE_SIZE;
+                    continue;
+                }
+                uint32_t run_end = addr + FLASH_SECTOR_ERASE_SIZE;
+                while (run_end < end && !blank_map->is_blank(run_end)) run_end += FLASH_SECTOR_ERASE_SIZE;
+                bar.progress(addr-start, end-start);
+                con.flash_erase(addr, run_end - addr);
+                addr = run_end;
+            }
+        } else {
+            uint32_t block_size = get_flash_erase_block_size(con);
+            for (uint32_t addr = start; addr < end;) {
+                bar.progress(addr-start, end-start);
+                uint32_t this_size = FLASH_SECTOR_ERASE_SIZE;
+                if (!(addr & (block_size - 1)) && end - addr >= block_size) this_size = block_size;
+                con.flash_erase(addr, this_size);
+                addr += this_size;
+            }
         }
         bar.progress(100);
     }
     std::cout << "Erased " << size << " bytes\n";
+    if (blank_map && blank_map->blank_count()) {
+        std::cout << "  " << blank_map->blank_count() << " of " << blank_map->sector_count() << " sectors were already erased, and were skipped\n";
+    }
     return false;
 }
 #endif
@@ -4700,6 +6007,445 @@ bool get_target_partition(picoboot::connection &con, uint32_t* start = nullptr,
     }
 }
 
+// Compress data for the flash helper's decompressor. The format is a series of runs, each starting with a control
+// byte c: c < 0x80 is followed by c + 1 literal bytes, and c >= 0x80 is a copy of (c & 0x7f) + 3 bytes from an
+// earlier position in the output, given by a 16 bit little-endian distance back. Matches are found greedily
+// through a hash of the next 3 bytes, with the previous byte also tried so that runs of a single value are cheap.
+static vector<uint8_t> helper_compress(const uint8_t *data, uint32_t len) {
+    const uint32_t min_match = 3;
+    const uint32_t max_match = 0x7f + min_match;
+    const uint32_t max_literals = 0x80;
+    vector<uint8_t> out;
+    out.reserve(len / 2);
+    vector<int32_t> last_pos(1u << 16, -1);
+    auto hash = [&](uint32_t i) {
+        return ((data[i] << 8) ^ (data[i + 1] << 4) ^ data[i + 2] ^ (data[i] >> 4)) & 0xffffu;
+    };
+    uint32_t literal_start = 0;
+    auto flush_literals = [&](uint32_t end) {
+        while (literal_start < end) {
+            uint32_t n = std::min(end - literal_start, max_literals);
+            out.push_back(n - 1);
+            out.insert(out.end(), data + literal_start, data + literal_start + n);
+            literal_start += n;
+        }
+    };
+    uint32_t i = 0;
+    while (i < len) {
+        uint32_t best_len = 0;
+        uint32_t best_dist = 0;
+        if (i + min_match <= len) {
+            uint32_t h = hash(i);
+            int32_t candidates[2] = {last_pos[h], (int32_t)i - 1};
+            for (int32_t c : candidates) {
+                if (c < 0 || i - c > 0xffff) continue;
+                uint32_t l = 0;
+                while (l < max_match && i + l < len && data[c + l] == data[i + l]) l++;
+                if (l > best_len) {
+                    best_len = l;
+                    best_dist = i - c;
+                }
+            }
+            last_pos[h] = i;
+        }
+        if (best_len >= min_match) {
+            flush_literals(i);
+            out.push_back(0x80 + best_len - min_match);
+            out.push_back(best_dist & 0xff);
+            out.push_back(best_dist >> 8);
+            for (uint32_t j = i + 1; j < i + best_len && j + min_match <= len; j++) {
+                last_pos[hash(j)] = j;
+            }
+            i += best_len;
+            literal_start = i;
+        } else {
+            i++;
+        }
+    }
+    flush_literals(len);
+    return out;
+}
+
+// Programs RP2040 flash through a helper running on core 1: the helper erases and programs one SRAM buffer while
+// the next is sent over USB, so USB transfers overlap with flash operations rather than adding to them. Buffers may
+// be sent compressed, in which case the helper decompresses them first. The helper reports a CRC of the data it
+// programs, which is checked against the data sent. The host hands buffers over through a mailbox in SRAM, and must
+// not touch flash through the bootrom until finish()
+struct staged_flasher {
+    static constexpr uint32_t code_addr = SRAM_START + 0x30000;
+    static constexpr uint32_t mailbox_addr = code_addr + 0x200;
+    static constexpr uint32_t stack_top = code_addr + 0x1000;
+    static constexpr uint32_t decompress_addr = SRAM_START;
+    static constexpr uint32_t buffer_addr = SRAM_START + 0x10000;
+    static constexpr uint32_t buffer_size = 0x10000;
+    static constexpr uint32_t num_slots = 2;
+    static constexpr uint32_t magic = 0x48534c46; // "FLSH", written by the helper when it starts
+    static constexpr uint32_t stop_offset = 0x48; // reset_core1 in the program below
+
+    // SRAM used by the helper, which the data being loaded must not overlap
+    static range sram_used() {
+        return range(decompress_addr, stack_top);
+    }
+
+    staged_flasher(picoboot::connection &con, memory_access &raw_access, bool compress) : con(con), compress(compress) {
+        // Core 0 (exec'd by PICOBOOT): reset core 1, then run the SIO FIFO launch sequence to start it at
+        // core1_entry. Core 1: wait for each slot in turn to be full, decompress it if needed (see helper_compress),
+        // record the CRC of the data, erase and program it with the boot ROM flash functions, then mark it free
+        // and count it as completed.
+        std::vector<uint32_t> program = {
+                0x4c48b5f0, // launch: push {r4-r7, lr};  ldr r4, sio_base
+                0xf820f000, // bl reset_core1
+                0x2600a54d, // adr r5, launch_seq;  movs r6, #0
+                0x00b04b46, // ldr r3, timeout;  next_cmd: lsls r0, r6, #2
+                0x2f00582f, // ldr r7, [r5, r0];  cmp r7, #0
+                0x6d20d105, // bne push_cmd;  drain: ldr r0, [r4, #0x50]
+                0xd50107c0, // lsls r0, r0, #31;  bpl drained
+                0xe7fa6da0, // ldr r0, [r4, #0x58];  b drain
+                0x6d20bf40, // drained: sev;  push_cmd: ldr r0, [r4, #0x50]
+                0xd5fc0780, // lsls r0, r0, #30;  bpl push_cmd
+                0xbf406567, // str r7, [r4, #0x54];  sev
+                0xd00a3b01, // wait: subs r3, #1;  beq done
+                0x07c06d20, // ldr r0, [r4, #0x50];  lsls r0, r0, #31
+                0x6da0d5fa, // bpl wait;  ldr r0, [r4, #0x58]
+                0xd00142b8, // cmp r0, r7;  beq matched
+                0xe7e62600, // movs r6, #0;  b next_cmd
+                0x2e063601, // matched: adds r6, #1;  cmp r6, #6
+                0xbdf0d1e3, // bne next_cmd;  done: pop {r4-r7, pc}
+                0x21014838, // reset_core1: ldr r0, psm_frce_off_set;  movs r1, #1
+                0x60010409, // lsls r1, r1, #16;  str r1, [r0]
+                0x68104a37, // ldr r2, psm_frce_off;  wait_off: ldr r0, [r2]
+                0xd0fc4208, // tst r0, r1;  beq wait_off
+                0x60014836, // ldr r0, psm_frce_off_clr;  str r1, [r0]
+                0x4c364770, // bx lr;  core1_entry: ldr r4, mailbox
+                0x60204836, // ldr r0, magic;  str r0, [r4, #0]
+                0x016e2500, // movs r5, #0;  slot_loop: lsls r6, r5, #5
+                0x19363620, // adds r6, #32;  adds r6, r6, r4
+                0x28016930, // wait_slot: ldr r0, [r6, #16];  cmp r0, #1
+                0x68f1d1fc, // bne wait_slot;  ldr r1, [r6, #12]
+                0x28006970, // ldr r0, [r6, #20];  cmp r0, #0
+                0x1840d01f, // beq crc;  adds r0, r0, r1
+                0xb4246962, // ldr r2, [r4, #20];  push {r2, r5}
+                0xd2194281, // dloop: cmp r1, r0;  bhs ddone
+                0x3101780b, // ldrb r3, [r1];  adds r1, #1
+                0xd2072b80, // cmp r3, #0x80;  bhs dmatch
+                0x780d3301, // adds r3, #1;  dlit: ldrb r5, [r1]
+                0x31017015, // strb r5, [r2];  adds r1, #1
+                0x3b013201, // adds r2, #1;  subs r3, #1
+                0xe7f1d1f9, // bne dlit;  b dloop
+                0x780d3b7d, // dmatch: subs r3, #0x7d;  ldrb r5, [r1]
+                0x023f784f, // ldrb r7, [r1, #1];  lsls r7, r7, #8
+                0x3102433d, // orrs r5, r7;  adds r1, #2
+                0x782f1b55, // subs r5, r2, r5;  dcopy: ldrb r7, [r5]
+                0x35017017, // strb r7, [r2];  adds r5, #1
+                0x3b013201, // adds r2, #1;  subs r3, #1
+                0xe7e3d1f9, // bne dcopy;  b dloop
+                0x68b2bc22, // ddone: pop {r1, r5};  crc: ldr r2, [r6, #8]
+                0x2000b422, // push {r1, r5};  movs r0, #0
+                0xa72543c0, // mvns r0, r0;  adr r7, crc_table
+                0xd0102a00, // crc_loop: cmp r2, #0;  beq crc_done
+                0x4058780b, // ldrb r3, [r1];  eors r0, r3
+                0x4003230f, // movs r3, #15;  ands r3, r0
+                0x58fb009b, // lsls r3, r3, #2;  ldr r3, [r7, r3]
+                0x40580900, // lsrs r0, r0, #4;  eors r0, r3
+                0x4003230f, // movs r3, #15;  ands r3, r0
+                0x58fb009b, // lsls r3, r3, #2;  ldr r3, [r7, r3]
+                0x40580900, // lsrs r0, r0, #4;  eors r0, r3
+                0x3a013101, // adds r1, #1;  subs r2, #1
+                0x61b0e7ec, // b crc_loop;  crc_done: str r0, [r6, #24]
+                0x29006871, // ldr r1, [r6, #4];  cmp r1, #0
+                0x6830d005, // beq program;  ldr r0, [r6, #0]
+                0x04122201, // movs r2, #1;  lsls r2, r2, #16
+                0x686723d8, // movs r3, #0xd8;  ldr r7, [r4, #4]
+                0xbc2247b8, // blx r7;  program: pop {r1, r5}
+                0x2a0068b2, // ldr r2, [r6, #8];  cmp r2, #0
+                0x6830d002, // beq slot_done;  ldr r0, [r6, #0]
+                0x47b868a7, // ldr r7, [r4, #8];  blx r7
+                0x61302000, // slot_done: movs r0, #0;  str r0, [r6, #16]
+                0x300168e0, // ldr r0, [r4, #12];  adds r0, #1
+                0x350160e0, // str r0, [r4, #12];  adds r5, #1
+                0x42856920, // ldr r0, [r4, #16];  cmp r5, r0
+                0x2500d1a3, // bne slot_loop;  movs r5, #0
+                0x46c0e7a1, // b slot_loop;  (padding)
+                0xd0000000, // sio_base
+                0x00100000, // timeout
+                0x40012004, // psm_frce_off_set (PSM_BASE + FRCE_OFF, atomic set alias)
+                0x40010004, // psm_frce_off
+                0x40013004, // psm_frce_off_clr (atomic clear alias)
+                mailbox_addr,
+                magic,
+                0, 0, 1, 0, stack_top, code_addr + 0x5e + 1, // launch_seq: vector table, stack pointer, entry
+        };
+        // crc_table: reflected CRC-32 a nibble at a time
+        for (uint32_t i = 0; i < 16; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 4; bit++) crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+            program.push_back(crc);
+        }
+        assert(program.size() * 4 <= mailbox_addr - code_addr);
+        // mailbox: magic, erase function, program function, completed count, slot count, decompression buffer,
+        // then the slots
+        std::vector<uint32_t> mailbox(8 + num_slots * 8);
+        mailbox[1] = bootrom_func_lookup(raw_access, rom_table_code('R','E'));
+        mailbox[2] = bootrom_func_lookup(raw_access, rom_table_code('R','P'));
+        mailbox[4] = num_slots;
+        mailbox[5] = decompress_addr;
+        for (uint32_t i = 0; i < num_slots; i++) {
+            mailbox[8 + i * 8 + slot_buffer] = buffer_addr + i * buffer_size;
+        }
+        con.exit_xip();
+        raw_access.write_vector(code_addr, program);
+        raw_access.write_vector(mailbox_addr, mailbox);
+        con.exec(code_addr);
+        if (read_word(mailbox_addr) != magic) {
+            fail(ERROR_NOT_POSSIBLE, "The flash helper did not start on the device");
+        }
+        running = true;
+    }
+
+    ~staged_flasher() {
+        try {
+            stop();
+        } catch (std::exception &) {
+            // the device will be left with core 1 busy, which is cleared by the next reboot
+        }
+    }
+
+    // Queue the erase and program of len bytes at the sector aligned flash address
+    void write(uint32_t address, uint8_t *data, uint32_t len) {
+        assert(!(address & (FLASH_SECTOR_ERASE_SIZE - 1)) && !(len & (FLASH_SECTOR_ERASE_SIZE - 1)));
+        while (len) {
+            uint32_t this_len = std::min(len, (uint32_t)buffer_size);
+            uint32_t slot = slot_addr(next_slot);
+            wait_for_slot(next_slot);
+            uint32_t compressed_len = 0;
+            vector<uint8_t> compressed;
+            if (compress) {
+                compressed = helper_compress(data, this_len);
+                if (compressed.size() < this_len) compressed_len = compressed.size();
+            }
+            if (compressed_len) {
+                con.write(buffer_addr + next_slot * buffer_size, compressed.data(), compressed_len);
+            } else {
+                con.write(buffer_addr + next_slot * buffer_size, data, this_len);
+            }
+            uint32_t header[6] = {address - FLASH_START, this_len, this_len, buffer_addr + next_slot * buffer_size, 0, compressed_len};
+            con.write(slot, (uint8_t *)header, sizeof(header));
+            // the state is written separately, so the helper can't see the slot as full before the header arrives
+            uint32_t full = 1;
+            con.write(slot + slot_state * 4, (uint8_t *)&full, sizeof(full));
+            pending[next_slot] = {true, address, crc32_reflected_update(0xffffffff, data, this_len)};
+            wire_bytes += (compressed_len ? compressed_len : this_len) + sizeof(header) + sizeof(full);
+            logical_bytes += this_len;
+            next_slot = (next_slot + 1) % num_slots;
+            address += this_len;
+            data += this_len;
+            len -= this_len;
+        }
+    }
+
+    // Wait for all queued writes to complete, and stop the helper
+    void finish() {
+        for (uint32_t i = 0; i < num_slots; i++) {
+            wait_for_slot(i);
+        }
+        stop();
+    }
+
+    // Bytes sent over USB for flash data (including slot headers), and the bytes of flash data they carried
+    uint64_t wire_bytes = 0;
+    uint64_t logical_bytes = 0;
+
+private:
+    enum { slot_offset, slot_erase_len, slot_program_len, slot_buffer, slot_state, slot_compressed_len, slot_crc };
+
+    struct pending_write {
+        bool queued;
+        uint32_t address;
+        uint32_t crc;
+    };
+
+    static uint32_t slot_addr(uint32_t slot) {
+        return mailbox_addr + 32 + slot * 32;
+    }
+
+    uint32_t read_word(uint32_t addr) {
+        uint32_t word;
+        con.read(addr, (uint8_t *)&word, sizeof(word));
+        return word;
+    }
+
+    // Wait for the helper to finish with a slot, and check the CRC of what it programmed from it
+    void wait_for_slot(uint32_t index) {
+        uint32_t slot = slot_addr(index);
+        auto last_progress = std::chrono::steady_clock::now();
+        uint32_t completed = read_word(mailbox_addr + 12);
+        uint32_t status[3]; // state, compressed length and CRC
+        for (;;) {
+            con.read(slot + slot_state * 4, (uint8_t *)status, sizeof(status));
+            if (!status[0]) break;
+            uint32_t now_completed = read_word(mailbox_addr + 12);
+            if (now_completed != completed) {
+                completed = now_completed;
+                last_progress = std::chrono::steady_clock::now();
+            } else if (std::chrono::steady_clock::now() - last_progress > std::chrono::seconds(10)) {
+                fail(ERROR_WRITE_FAILED, "The flash helper on the device stopped responding");
+            }
+        }
+        if (pending[index].queued) {
+            pending[index].queued = false;
+            if (status[2] != pending[index].crc) {
+                fail(ERROR_VERIFICATION_FAILED, "The data programmed at 0x%08x by the flash helper has the wrong CRC", pending[index].address);
+            }
+        }
+    }
+
+    void stop() {
+        if (running) {
+            running = false;
+            con.exec(code_addr + stop_offset);
+        }
+    }
+
+    picoboot::connection &con;
+    bool compress;
+    uint32_t next_slot = 0;
+    pending_write pending[num_slots] = {};
+    bool running = false;
+};
+
+// Write data to the sector aligned flash address, given the current contents of that flash. NOR flash can be programmed
+// from 1 to 0 without an erase, so only the sectors that need a bit set are erased, and only pages that change are written
+static void write_flash_avoiding_erase(picoboot::connection &con, picoboot_memory_access &raw_access, uint32_t address,
+                                       vector<uint8_t> &data, const vector<uint8_t> &current,
+                                       uint32_t &changed_sectors, uint32_t &erased_sectors) {
+    assert(data.size() == current.size() && !(data.size() & (FLASH_SECTOR_ERASE_SIZE - 1)));
+    uint32_t sector_count = data.size() / FLASH_SECTOR_ERASE_SIZE;
+    vector<bool> erase(sector_count);
+    for (uint32_t s = 0; s < sector_count; s++) {
+        uint32_t from = s * FLASH_SECTOR_ERASE_SIZE;
+        bool changed = false;
+        for (uint32_t i = from; i < from + FLASH_SECTOR_ERASE_SIZE; i++) {
+            changed |= data[i] != current[i];
+            if ((data[i] & current[i]) != data[i]) {
+                erase[s] = true;
+                break;
+            }
+        }
+        if (changed || erase[s]) changed_sectors++;
+    }
+    for (uint32_t s = 0; s < sector_count;) {
+        uint32_t e = s;
+        while (e < sector_count && erase[e]) e++;
+        if (e > s) {
+            con.flash_erase(address + s * FLASH_SECTOR_ERASE_SIZE, (e - s) * FLASH_SECTOR_ERASE_SIZE);
+            erased_sectors += e - s;
+            s = e;
+        } else {
+            s++;
+        }
+    }
+    // write runs of pages that differ from what is now in flash (which is all 0xff in erased sectors)
+    auto page_needed = [&](uint32_t offset) {
+        bool erased = erase[offset / FLASH_SECTOR_ERASE_SIZE];
+        for (uint32_t i = offset; i < offset + PAGE_SIZE; i++) {
+            if (data[i] != (erased ? 0xff : current[i])) return true;
+        }
+        return false;
+    };
+    for (uint32_t offset = 0; offset < data.size();) {
+        uint32_t end = offset;
+        while (end < data.size() && page_needed(end)) end += PAGE_SIZE;
+        if (end > offset) {
+            raw_access.write(address + offset, data.data() + offset, end - offset);
+            offset = end;
+        } else {
+            offset += PAGE_SIZE;
+        }
+    }
+}
+
+// Erase and program only the sectors of data that differ from the current contents of flash at the sector aligned
+// address, with one erase and one write for each run of changed sectors
+static void write_changed_sectors(picoboot::connection &con, picoboot_memory_access &raw_access, uint32_t address,
+                                  const vector<uint8_t> &data, const vector<uint8_t> &current, uint32_t &changed_sectors) {
+    assert(data.size() == current.size() && !(data.size() & (FLASH_SECTOR_ERASE_SIZE - 1)));
+    auto changed = [&](uint32_t offset) {
+        return memcmp(data.data() + offset, current.data() + offset, FLASH_SECTOR_ERASE_SIZE) != 0;
+    };
+    for (uint32_t offset = 0; offset < data.size();) {
+        uint32_t end = offset;
+        while (end < data.size() && changed(end)) end += FLASH_SECTOR_ERASE_SIZE;
+        if (end > offset) {
+            con.flash_erase(address + offset, end - offset);
+            raw_access.write(address + offset, (uint8_t *)data.data() + offset, end - offset);
+            changed_sectors += (end - offset) / FLASH_SECTOR_ERASE_SIZE;
+            offset = end;
+        } else {
+            offset += FLASH_SECTOR_ERASE_SIZE;
+        }
+    }
+}
+
+// The number of sectors of data, to be loaded at the sector aligned address in the --ab target partition, that differ
+// from the same sectors of the other slot. Sectors past the end of the other slot all differ. There is no way to copy
+// flash on the device during a PICOBOOT session on RP2350 (it has no EXEC command), so these are counted rather than
+// being the only sectors sent
+static uint32_t count_ab_partner_changes(picoboot_memory_access &raw_access, uint32_t address, const vector<uint8_t> &data) {
+    uint32_t slot_offset = address - settings.offset;
+    uint32_t partner_len = 0;
+    if (address >= settings.offset && slot_offset < settings.load.ab_partner_size) {
+        partner_len = std::min((uint32_t)data.size(), settings.load.ab_partner_size - slot_offset);
+    }
+    vector<uint8_t> partner_buf;
+    if (partner_len) {
+        raw_access.read_into_vector(settings.load.ab_partner + slot_offset, partner_len, partner_buf);
+    }
+    uint32_t changed = 0;
+    for (uint32_t offset = 0; offset < data.size(); offset += FLASH_SECTOR_ERASE_SIZE) {
+        if (offset >= partner_len || memcmp(data.data() + offset, partner_buf.data() + offset, FLASH_SECTOR_ERASE_SIZE)) {
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// Reboot the device to run the image starting at start, which has just been loaded
+static void execute_loaded_image(picoboot::connection &con, uint32_t start, model_t model) {
+    if (!start) {
+        fail(ERROR_FORMAT, "Cannot execute as file does not contain a valid RP2 executable image");
+    }
+    if (model == rp2350) {
+        struct picoboot_reboot2_cmd cmd;
+        auto mt = get_memory_type(start, model);
+        if (mt == flash) {
+            cmd.dParam0 = settings.offset;
+            cmd.dFlags = REBOOT2_FLAG_REBOOT_TYPE_FLASH_UPDATE;
+            DEBUG_LOG(">>> using flash update boot of %08x\n", cmd.dParam0);
+        } else {
+            cmd.dParam0 = start;
+            unsigned int end;
+            switch (mt) {
+                case sram:
+                    end = SRAM_END_RP2350;
+                    break;
+                case xip_sram:
+                    end = XIP_SRAM_END_RP2350;
+                    break;
+                default:
+                    end = SRAM_END_RP2350;
+            }
+            cmd.dParam1 = end - start;
+            cmd.dFlags = REBOOT2_FLAG_REBOOT_TYPE_RAM_IMAGE;
+            DEBUG_LOG(">>> using flash update boot of %08x\n", cmd.dParam0);
+        }
+        cmd.dDelayMS = 500,
+        con.reboot2(&cmd);
+    } else {
+        con.reboot(flash == get_memory_type(start, model) ? 0 : start,
+                   model == rp2040 ? SRAM_END_RP2040 : SRAM_END_RP2350, 500);
+    }
+}
+
 bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
     picoboot_memory_access raw_access(con);
     range flash_binary_range(FLASH_START, FLASH_END_RP2350); // pick biggest (rp2350) here for now
@@ -4754,7 +6500,7 @@ bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
         uint32_t flash_data_size = flash_max - flash_min;
         assert(flash_min >= FLASH_START);
         uint32_t flash_start_offset = flash_min - FLASH_START;
-        uint32_t size_guess = guess_flash_size(raw_access);
+        uint32_t size_guess = get_flash_size(con, raw_access);
         if (size_guess > 0) {
             // Skip check when targeting PSRAM, which is anything above 0x11000000
             if (flash_start_offset < FLASH_END_RP2040 && (flash_start_offset + flash_data_size) > size_guess) {
@@ -4771,19 +6517,62 @@ bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
             }
         }
     }
+    std::unique_ptr<staged_flasher> flasher;
+    if ((settings.load.staged || settings.load.compress) && uses_flash) {
+        // --compress on its own falls back to the raw path, rather than failing, if the helper can't be used
+        string reason;
+        if (model != rp2040) {
+            reason = "the flash helper is only supported on RP2040";
+        } else if (settings.load.update || settings.load.avoid_erase || settings.load.ab) {
+            if (settings.load.staged) {
+                fail(ERROR_ARGS, "--staged cannot be combined with --update, --avoid-erase or --ab, as they read flash while it is being written");
+            }
+            reason = "--update, --avoid-erase and --ab read flash while the helper would be writing it";
+        } else {
+            auto used = staged_flasher::sram_used();
+            for (auto mem_range : ranges) {
+                if (mem_range.from < used.to && used.from < mem_range.to) {
+                    reason = "the file contains data for " + hex_string(mem_range.from) + "-" + hex_string(mem_range.to) + " which the flash helper uses";
+                }
+            }
+        }
+        if (reason.empty()) {
+            try {
+                flasher = std::unique_ptr<staged_flasher>(new staged_flasher(con, raw_access, settings.load.compress));
+            } catch (command_failure &e) {
+                if (settings.load.staged) throw;
+                reason = e.what();
+            }
+        }
+        if (!flasher) {
+            if (settings.load.staged) {
+                fail(ERROR_NOT_POSSIBLE, "--staged cannot be used, as %s", reason.c_str());
+            }
+            std::cout << "Loading uncompressed, as " << reason << "\n";
+        }
+    }
+    uint32_t changed_sectors = 0;
+    uint32_t erased_sectors = 0;
+    uint32_t ab_sectors = 0;
+    uint32_t ab_partner_changed_sectors = 0;
     for (auto mem_range : ranges) {
         enum memory_type type = get_memory_type(mem_range.from, model);
         // new scope for progress bar
         {
             progress_bar bar("Loading into " + memory_names[type] + ": ");
-            // Use batches of size/100 rounded up to FLASH_SECTOR_ERASE_SIZE
+            // Use batches of size/100 rounded up to FLASH_SECTOR_ERASE_SIZE; for flash, batches are whole erase blocks
+            // where possible, so they can be erased a block at a time
             uint32_t batch_size = calculate_chunk_size(mem_range.len());
+            uint32_t erase_block_size = type == flash ? get_flash_erase_block_size(con) : FLASH_SECTOR_ERASE_SIZE;
+            batch_size = (batch_size + erase_block_size - 1) & ~(erase_block_size - 1);
             bool ok = true;
             vector<uint8_t> file_buf;
             vector<uint8_t> device_buf;
             for (uint32_t base = mem_range.from; base < mem_range.to && ok;) {
                 uint32_t this_batch = std::min(mem_range.to - base, batch_size);
                 if (type == flash) {
+                    uint32_t block_end = (base + this_batch) & ~(erase_block_size - 1);
+                    if (block_end > base) this_batch = block_end - base;
                     // we have to erase an entire page, so then fill with zeros
                     range aligned_range(base & ~(FLASH_SECTOR_ERASE_SIZE - 1),
                                         (base + this_batch + FLASH_SECTOR_ERASE_SIZE - 1) & ~(FLASH_SECTOR_ERASE_SIZE - 1));
@@ -4796,15 +6585,27 @@ bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
                     assert(file_buf.size() == aligned_range.len());
 
                     bool skip = false;
-                    if (settings.load.update) {
-                        vector<uint8_t> read_device_buf;
-                        raw_access.read_into_vector(aligned_range.from, file_buf.size(), read_device_buf);
-                        skip = file_buf == read_device_buf;
+                    if (settings.load.update || settings.load.avoid_erase || settings.load.ab) {
+                        raw_access.read_into_vector(aligned_range.from, file_buf.size(), device_buf);
+                        skip = file_buf == device_buf;
                     }
-                    if (!skip) {
+                    if (settings.load.ab) {
+                        ab_sectors += file_buf.size() / FLASH_SECTOR_ERASE_SIZE;
+                        ab_partner_changed_sectors += count_ab_partner_changes(raw_access, aligned_range.from, file_buf);
+                    }
+                    if (flasher) {
+                        flasher->write(aligned_range.from, file_buf.data(), file_buf.size());
+                    } else if (!skip) {
                         con.exit_xip();
-                        con.flash_erase(aligned_range.from, file_buf.size());
-                        raw_access.write_vector(aligned_range.from, file_buf);
+                        if (settings.load.ab && !settings.load.avoid_erase) {
+                            write_changed_sectors(con, raw_access, aligned_range.from, file_buf, device_buf, changed_sectors);
+                        } else if (settings.load.avoid_erase) {
+                            write_flash_avoiding_erase(con, raw_access, aligned_range.from, file_buf, device_buf,
+                                                       changed_sectors, erased_sectors);
+                        } else {
+                            con.flash_erase(aligned_range.from, file_buf.size());
+                            raw_access.write_vector(aligned_range.from, file_buf);
+                        }
                     }
                     base = read_range.to; // about to add batch_size
                 } else {
@@ -4816,6 +6617,21 @@ bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
             }
         }
     }
+    if (flasher) {
+        flasher->finish();
+        if (settings.load.compress && flasher->logical_bytes) {
+            std::cout << "  Sent " << flasher->wire_bytes << " bytes over USB for " << flasher->logical_bytes << " bytes of flash data ("
+                      << std::fixed << std::setprecision(1) << (double)flasher->logical_bytes / flasher->wire_bytes << "x)\n";
+        }
+    }
+    if (settings.load.avoid_erase && changed_sectors) {
+        std::cout << "  " << changed_sectors - erased_sectors << " of " << changed_sectors << " changed flash sectors were written without an erase\n";
+    } else if (settings.load.ab && ab_sectors) {
+        std::cout << "  " << changed_sectors << " of " << ab_sectors << " flash sectors differed from the partition, and were written\n";
+    }
+    if (settings.load.ab && ab_sectors) {
+        std::cout << "  " << ab_partner_changed_sectors << " of " << ab_sectors << " flash sectors differ from the other slot\n";
+    }
     for (auto mem_range : ranges) {
         enum memory_type type = get_memory_type(mem_range.from, model);
         if (settings.load.verify) {
@@ -4856,50 +6672,17 @@ bool load_guts(picoboot::connection con, iostream_memory_access &file_access) {
         }
     }
     if (settings.load.execute) {
-        uint32_t start = file_access.get_binary_start();
-        if (!start) {
-            fail(ERROR_FORMAT, "Cannot execute as file does not contain a valid RP2 executable image");
-        }
-        if (get_model(raw_access) == rp2350) {
-            struct picoboot_reboot2_cmd cmd;
-            auto mt = get_memory_type(start, model);
-            if (mt == flash) {
-                cmd.dParam0 = settings.offset;
-                cmd.dFlags = REBOOT2_FLAG_REBOOT_TYPE_FLASH_UPDATE;
-                DEBUG_LOG(">>> using flash update boot of %08x\n", cmd.dParam0);
-            } else {
-                cmd.dParam0 = start;
-                unsigned int end;
-                switch (mt) {
-                    case sram:
-                        end = SRAM_END_RP2350;
-                        break;
-                    case xip_sram:
-                        end = XIP_SRAM_END_RP2350;
-                        break;
-                    default:
-                        end = SRAM_END_RP2350;
-                }
-                cmd.dParam1 = end - start;
-                cmd.dFlags = REBOOT2_FLAG_REBOOT_TYPE_RAM_IMAGE;
-                DEBUG_LOG(">>> using flash update boot of %08x\n", cmd.dParam0);
-            }
-            cmd.dDelayMS = 500,
-            con.reboot2(&cmd);
-        } else {
-            con.reboot(flash == get_memory_type(start, model) ? 0 : start,
-                       model == rp2040 ? SRAM_END_RP2040 : SRAM_END_RP2350, 500);
-        }
+        execute_loaded_image(con, file_access.get_binary_start(), model);
         std::cout << "\nThe device was rebooted to start the application.\n";
         return true;
     }
     return false;
 }
 
-bool load_command::execute(device_map &devices) {
-    auto con = get_single_bootsel_device_connection(devices);
-    picoboot_memory_access raw_access(con);
-    auto tmp_file_access = get_file_memory_access(0);
+// Set the offset to load at from the -p partition, or for a flash image when partitions aren't ignored, from the
+// partition the bootrom would choose for its family
+static void choose_load_partition(picoboot::connection &con, model_t model, uint32_t binary_start,
+                                  const std::function<uint32_t()> &get_family) {
     if (settings.load.partition >= 0) {
         auto partitions = get_partitions(con);
         if (!partitions) {
@@ -4915,12 +6698,12 @@ bool load_command::execute(device_map &devices) {
         settings.offset = start + FLASH_START;
         settings.offset_set = true;
         settings.partition_size = end - start;
-    } else if (!settings.load.ignore_pt && !settings.offset_set && tmp_file_access.get_binary_start() == FLASH_START) {
-        uint32_t family_id = get_family_id(0);
+    } else if (!settings.load.ignore_pt && !settings.offset_set && binary_start == FLASH_START) {
+        uint32_t family_id = get_family();
         settings.family_id = family_id;
         uint32_t start;
         uint32_t end;
-        if (get_model(raw_access) != rp2040) {
+        if (model != rp2040) {
             if (get_target_partition(con, &start, &end)) {
                 settings.offset = start + FLASH_START;
                 settings.offset_set = true;
@@ -4936,11 +6719,676 @@ bool load_command::execute(device_map &devices) {
             }
         }
     }
-    auto file_access = get_file_memory_access(0);
+}
+
+static int reboot_device(libusb_device *device, libusb_device_handle *dev_handle, bool bootsel, unsigned int disable_mask);
+
+// Digests of the flash sectors last loaded by load --watch, keyed on sector address
+typedef std::map<uint32_t, uint64_t> sector_digests;
+
+// The MSB-first and reflected CRC-32s of one flash sector, so a changed sector is never realistically mistaken for an
+// unchanged one; both run on the accelerated CRC kernels, which is much faster than a byte-at-a-time hash
+static uint64_t sector_digest(const uint8_t *data) {
+    return (uint64_t)crc32_msb_update(0xffffffff, data, FLASH_SECTOR_ERASE_SIZE) << 32 |
+           crc32_reflected_update(0xffffffff, data, FLASH_SECTOR_ERASE_SIZE);
+}
+
+// Call f with the address and contents of each flash sector in file_access, zero filled in the same way load_guts
+// writes it
+static void for_each_flash_sector(iostream_memory_access &file_access, model_t model,
+                                  const std::function<void(uint32_t, const vector<uint8_t> &)> &f) {
+    vector<uint8_t> buf;
+    for (auto mem_range : get_coalesced_ranges(file_access, model)) {
+        if (get_memory_type(mem_range.from, model) != flash) continue;
+        for (uint32_t sector = mem_range.from & ~(FLASH_SECTOR_ERASE_SIZE - 1); sector < mem_range.to; sector += FLASH_SECTOR_ERASE_SIZE) {
+            range read_range(sector, sector + FLASH_SECTOR_ERASE_SIZE);
+            read_range.intersect(mem_range);
+            file_access.read_into_vector(read_range.from, read_range.len(), buf, true);
+            buf.insert(buf.begin(), read_range.from - sector, 0);
+            buf.resize(FLASH_SECTOR_ERASE_SIZE, 0);
+            f(sector, buf);
+        }
+    }
+}
+
+// Load file_access, erasing and programming only the flash sectors whose digest differs from the one in digests, with
+// one erase and one write for each run of changed sectors. Other memory is written in full. Returns the number of
+// flash sectors written
+static uint32_t load_changed_sectors(picoboot::connection &con, iostream_memory_access &file_access, model_t model,
+                                     sector_digests &digests) {
+    picoboot_memory_access raw_access(con);
+    for (auto mem_range : get_coalesced_ranges(file_access, model)) {
+        enum memory_type t1 = get_memory_type(mem_range.from, model);
+        enum memory_type t2 = get_memory_type(mem_range.to, model);
+        if (t1 != t2 || t1 == invalid || t1 == rom || t1 == sram_unstriped) {
+            fail(ERROR_FORMAT, "File to load contained an invalid memory range 0x%08x-0x%08x", mem_range.from,
+                 mem_range.to);
+        }
+        if (t1 != flash) {
+            vector<uint8_t> buf;
+            file_access.read_into_vector(mem_range.from, mem_range.len(), buf);
+            raw_access.write_vector(mem_range.from, buf);
+        }
+    }
+    uint32_t changed_sectors = 0;
+    uint32_t run_start = 0;
+    vector<uint8_t> run;
+    vector<pair<uint32_t, uint64_t>> run_digests;
+    auto write_run = [&]() {
+        if (run.empty()) return;
+        // forget the old digests first, so that a failed write leaves these sectors to be written again
+        for (auto &d : run_digests) digests.erase(d.first);
+        con.exit_xip();
+        con.flash_erase(run_start, run.size());
+        raw_access.write_vector(run_start, run);
+        if (settings.load.verify) {
+            vector<uint8_t> device_buf;
+            raw_access.read_into_vector(run_start, run.size(), device_buf);
+            if (device_buf != run) {
+                fail(ERROR_VERIFICATION_FAILED, "The device contents did not match the file at 0x%08x-0x%08x", run_start, run_start + (uint32_t)run.size());
+            }
+        }
+        for (auto &d : run_digests) digests[d.first] = d.second;
+        changed_sectors += run_digests.size();
+        run.clear();
+        run_digests.clear();
+    };
+    for_each_flash_sector(file_access, model, [&](uint32_t sector, const vector<uint8_t> &data) {
+        uint64_t digest = sector_digest(data.data());
+        auto d = digests.find(sector);
+        if (d != digests.end() && d->second == digest) {
+            write_run();
+            return;
+        }
+        if (!run.empty() && run_start + run.size() != sector) write_run();
+        if (run.empty()) run_start = sector;
+        run.insert(run.end(), data.begin(), data.end());
+        run_digests.emplace_back(sector, digest);
+    });
+    write_run();
+    return changed_sectors;
+}
+
+// Waits for the named file to be rewritten, and then for writes to it to stop. On Linux this uses inotify on the
+// file's directory, so that a file replaced by renaming over it is also seen; elsewhere the file's size and
+// modification time are polled
+struct file_watcher {
+    static constexpr int settle_ms = 200;
+
+    explicit file_watcher(const string &filename) : filename(filename) {
+    #if defined(__linux__)
+        auto slash = filename.find_last_of('/');
+        string dir = slash == string::npos ? "." : filename.substr(0, slash + 1);
+        name = slash == string::npos ? filename : filename.substr(slash + 1);
+        fd = inotify_init1(IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        if (fd < 0) {
+            fail(ERROR_NOT_POSSIBLE, "Unable to watch %s for changes", filename.c_str());
+        }
+    #else
+        last = stamp();
+    #endif
+    }
+
+    ~file_watcher() {
+    #if defined(__linux__)
+        ::close(fd);
+    #endif
+    }
+
+    file_watcher(const file_watcher&) = delete;
+    file_watcher& operator=(const file_watcher&) = delete;
+
+    void wait() {
+    #if defined(__linux__)
+        bool changed = false;
+        while (true) {
+            struct pollfd pfd = {fd, POLLIN, 0};
+            int n = poll(&pfd, 1, changed ? settle_ms : -1);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) fail(ERROR_UNKNOWN, "Unable to watch %s for changes", filename.c_str());
+            if (!n) return; // nothing more within settle_ms of the last change
+            alignas(struct inotify_event) char buf[4096];
+            ssize_t len = read(fd, buf, sizeof(buf));
+            for (ssize_t pos = 0; pos < len;) {
+                auto event = (struct inotify_event *)(buf + pos);
+                if (event->len && name == event->name) changed = true;
+                pos += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    #else
+        auto previous = last;
+        do {
+            std::this_thread::sleep_for(std::chrono::milliseconds((int)settle_ms));
+            last = stamp();
+        } while (last == previous);
+        do {
+            previous = last;
+            std::this_thread::sleep_for(std::chrono::milliseconds((int)settle_ms));
+            last = stamp();
+        } while (last != previous);
+    #endif
+    }
+
+private:
+    string filename;
+#if defined(__linux__)
+    string name;
+    int fd = -1;
+#else
+    // size and modification time, or -1s if the file is missing
+    pair<int64_t, int64_t> stamp() const {
+        struct stat st;
+        if (stat(filename.c_str(), &st)) return {-1, -1};
+        return {(int64_t)st.st_size, (int64_t)st.st_mtime};
+    }
+    pair<int64_t, int64_t> last;
+#endif
+};
+
+// Wait for the device with the given serial number (any device if empty) to be in BOOTSEL mode, asking it to reboot
+// into BOOTSEL mode if it is running a program with a USB reset interface. Returns a handle in ctx
+static libusb_device_handle *wait_for_bootsel_device(libusb_context *ctx, const string &serial, model_t &model) {
+    bool asked = false;
+    fos << "Waiting for the device to be in BOOTSEL mode";
+    fos.flush();
+    while (true) {
+        libusb_device **devs;
+        if (libusb_get_device_list(ctx, &devs) < 0) {
+            fail(ERROR_USB, "Failed to enumerate USB devices\n");
+        }
+        libusb_device_handle *found = nullptr;
+        for (libusb_device **dev = devs; *dev && !found; dev++) {
+            libusb_device_handle *handle = nullptr;
+            model_t dev_model = unknown;
+            auto result = picoboot_open_device(*dev, &handle, &dev_model, settings.vid, settings.pid, serial.c_str());
+            if (result == dr_vidpid_bootrom_ok && handle) {
+                found = handle;
+                model = dev_model;
+                continue;
+            }
+            if (result == dr_vidpid_stdio_usb && handle && !asked) {
+                try {
+                    reboot_device(*dev, handle, true, 1);
+                } catch (command_failure &) {
+                    // no reset interface, so it has to be put in BOOTSEL mode by hand
+                }
+                asked = true;
+            }
+            if (handle) libusb_close(handle);
+        }
+        libusb_free_device_list(devs, 1);
+        if (found) {
+            fos << "\n";
+            return found;
+        }
+        fos << ".";
+        fos.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+}
+
+// load --watch: the initial load has left file_access on the device, so record its flash sector digests, then on each
+// change to the file load only the sectors whose digests differ. This only returns by the exception thrown on Ctrl-C
+static void watch_and_load(device_map &devices, picoboot::connection &initial_con, iostream_memory_access &file_access,
+                           model_t model, bool rebooted) {
+    sector_digests digests;
+    for_each_flash_sector(file_access, model, [&](uint32_t sector, const vector<uint8_t> &data) {
+        digests[sector] = sector_digest(data.data());
+    });
+    // the serial number picks the same device again, if it has to be found after a reboot
+    string serial = settings.ser;
+    if (serial.empty()) {
+        auto device = devices[dr_vidpid_bootrom_ok][0];
+        struct libusb_device_descriptor desc;
+        unsigned char ser_str[128];
+        if (!libusb_get_device_descriptor(std::get<1>(device), &desc) && desc.iSerialNumber &&
+            libusb_get_string_descriptor_ascii(std::get<2>(device), desc.iSerialNumber, ser_str, sizeof(ser_str)) > 0) {
+            serial = (char *)ser_str;
+        }
+    }
+    std::unique_ptr<libusb_context, void (*)(libusb_context *)> ctx(nullptr, libusb_exit);
+    std::unique_ptr<libusb_device_handle, void (*)(libusb_device_handle *)> handle(nullptr, libusb_close);
+    std::unique_ptr<picoboot::connection> found_con;
+    picoboot::connection *con = &initial_con;
+    file_watcher watcher(settings.filenames[0]);
+    std::cout << "\nWatching " << settings.filenames[0] << " for changes; press Ctrl-C to stop\n";
+    while (true) {
+        watcher.wait();
+        try {
+            parsed_image image(0);
+            auto changed_access = image.access();
+            if (rebooted) {
+                found_con.reset();
+                handle.reset();
+                if (!ctx) {
+                    libusb_context *new_ctx;
+                    if (libusb_init(&new_ctx)) {
+                        fail(ERROR_USB, "Failed to initialise libUSB\n");
+                    }
+                    ctx.reset(new_ctx);
+                }
+                model_t found_model;
+                handle.reset(wait_for_bootsel_device(ctx.get(), serial, found_model));
+                found_con.reset(new picoboot::connection(handle.get(), found_model));
+                con = found_con.get();
+                rebooted = false;
+            }
+            uint32_t changed_sectors = load_changed_sectors(*con, changed_access, model, digests);
+            std::cout << "Loaded " << settings.filenames[0] << ": " << changed_sectors << " flash sectors changed\n";
+            if (settings.load.execute) {
+                execute_loaded_image(*con, changed_access.get_binary_start(), model);
+                rebooted = true;
+                std::cout << "The device was rebooted to start the application.\n";
+            }
+        } catch (command_failure &e) {
+            std::cout << "ERROR: " << e.what() << "\n";
+        } catch (picoboot::command_failure &e) {
+            std::cout << "ERROR: The device returned an error: " << e.what() << "\n";
+        } catch (picoboot::connection_error &) {
+            // unplugged or reset, so find it again for the next change
+            std::cout << "ERROR: Communication with the device failed\n";
+            rebooted = true;
+        } catch (cancelled_exception &) {
+            throw;
+        } catch (std::exception &e) {
+            // e.g. from parsing a file that is only partly written; the next change will be tried again
+            std::cout << "ERROR: " << e.what() << "\n";
+        }
+    }
+}
+
+// True if input file idx is stdin ("-") or a pipe, which can only be read once, from start to end
+static bool is_stream_input(uint8_t idx) {
+    if (settings.filenames[idx] == "-") return true;
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    return !stat(settings.filenames[idx].c_str(), &st) && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode));
+#else
+    return false;
+#endif
+}
+
+// Reads a pipe on its own thread, so the device can be programmed while more data arrives. At most max_queued chunks
+// are held, after which the producer is held back by the pipe
+struct stream_reader {
+    static constexpr size_t chunk_size = 0x10000;
+    static constexpr size_t max_queued = 16;
+
+    explicit stream_reader(const string &filename) : state(std::make_shared<shared>()) {
+        if (filename == "-") {
+            state->fd = 0;
+        #if defined(_WIN32)
+            _setmode(0, _O_BINARY);
+        #endif
+        } else {
+        #if defined(__unix__) || defined(__APPLE__)
+            state->fd = ::open(filename.c_str(), O_RDONLY);
+        #endif
+            if (state->fd < 0) fail(ERROR_READ_FAILED, "Could not open '%s'", filename.c_str());
+            state->close_fd = true;
+        }
+        // The thread only uses the shared state, so it is detached rather than joined: if loading fails it may be
+        // blocked on a pipe that is never closed, and is then left to end with the process
+        std::thread(run, state).detach();
+    }
+
+    ~stream_reader() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->stopping = true;
+        state->cv.notify_all();
+    }
+
+    stream_reader(const stream_reader&) = delete;
+    stream_reader& operator=(const stream_reader&) = delete;
+
+    // Reads up to len bytes, returning fewer only at the end of the input
+    size_t read(uint8_t *buffer, size_t len) {
+        size_t done = 0;
+        while (done < len) {
+            if (pos == chunk.size()) {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->cv.wait(lock, [&]() { return !state->chunks.empty() || state->done; });
+                if (state->chunks.empty()) {
+                    if (state->failed) fail(ERROR_READ_FAILED, "Failed to read input file");
+                    break;
+                }
+                chunk = std::move(state->chunks.front());
+                state->chunks.pop_front();
+                pos = 0;
+                state->cv.notify_all();
+            }
+            size_t this_len = std::min(len - done, chunk.size() - pos);
+            memcpy(buffer + done, chunk.data() + pos, this_len);
+            pos += this_len;
+            done += this_len;
+        }
+        bytes_read += done;
+        return done;
+    }
+
+    uint64_t bytes_read = 0;
+
+private:
+    struct shared {
+        ~shared() {
+            if (close_fd) ::close(fd);
+        }
+        int fd = -1;
+        bool close_fd = false;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<vector<uint8_t>> chunks;
+        bool done = false;
+        bool failed = false;
+        bool stopping = false;
+    };
+
+    static void run(std::shared_ptr<shared> state) {
+        while (true) {
+            vector<uint8_t> buffer(chunk_size);
+        #if defined(_WIN32)
+            int n = _read(state->fd, buffer.data(), chunk_size);
+        #else
+            ssize_t n;
+            do {
+                n = ::read(state->fd, buffer.data(), chunk_size);
+            } while (n < 0 && errno == EINTR);
+        #endif
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cv.wait(lock, [&]() { return state->stopping || state->chunks.size() < max_queued; });
+            if (state->stopping) return;
+            if (n <= 0) {
+                state->done = true;
+                state->failed = n < 0;
+                state->cv.notify_all();
+                return;
+            }
+            buffer.resize(n);
+            state->chunks.push_back(std::move(buffer));
+            state->cv.notify_all();
+        }
+    }
+
+    std::shared_ptr<shared> state;
+    vector<uint8_t> chunk;
+    size_t pos = 0;
+};
+
+// Collects flash data arriving in any order into sectors, and erases and programs each sector as soon as it is
+// complete. At most max_pending incomplete sectors are held; beyond that the lowest is programmed with its gaps zero
+// filled (as load_guts fills them), and data arriving later for a programmed sector is merged with it on the device
+struct sector_assembler {
+    static constexpr uint32_t max_pending = 64;
+
+    sector_assembler(picoboot::connection &con, picoboot_memory_access &raw_access) : con(con), raw_access(raw_access) {}
+
+    void add(uint32_t address, const uint8_t *data, uint32_t len) {
+        while (len) {
+            uint32_t sector = address & ~(FLASH_SECTOR_ERASE_SIZE - 1);
+            uint32_t offset = address - sector;
+            uint32_t this_len = std::min(len, FLASH_SECTOR_ERASE_SIZE - offset);
+            auto p = pending.find(sector);
+            if (p == pending.end()) {
+                p = pending.emplace(sector, pending_sector()).first;
+                if (programmed.count(sector)) {
+                    // already programmed with gaps, so keep what is there
+                    raw_access.read(sector, p->second.data.data(), FLASH_SECTOR_ERASE_SIZE, false);
+                    p->second.filled.set();
+                    rewritten_sectors++;
+                }
+            }
+            memcpy(p->second.data.data() + offset, data, this_len);
+            for (uint32_t i = offset; i < offset + this_len; i++) p->second.filled.set(i);
+            if (p->second.filled.all()) {
+                program(p);
+            } else if (pending.size() > max_pending) {
+                program(pending.begin());
+            }
+            address += this_len;
+            data += this_len;
+            len -= this_len;
+        }
+    }
+
+    // Program the sectors that are still incomplete
+    void finish() {
+        while (!pending.empty()) program(pending.begin());
+    }
+
+    uint32_t written_sectors = 0;
+    uint32_t skipped_sectors = 0;
+    uint32_t rewritten_sectors = 0;
+
+private:
+    struct pending_sector {
+        vector<uint8_t> data = vector<uint8_t>(FLASH_SECTOR_ERASE_SIZE, 0);
+        std::bitset<FLASH_SECTOR_ERASE_SIZE> filled;
+    };
+
+    void program(std::map<uint32_t, pending_sector>::iterator p) {
+        uint32_t sector = p->first;
+        auto &data = p->second.data;
+        vector<uint8_t> device_buf;
+        if (settings.load.update) {
+            raw_access.read_into_vector(sector, FLASH_SECTOR_ERASE_SIZE, device_buf);
+        }
+        if (settings.load.update && device_buf == data) {
+            skipped_sectors++;
+        } else {
+            con.exit_xip();
+            con.flash_erase(sector, FLASH_SECTOR_ERASE_SIZE);
+            raw_access.write(sector, data.data(), FLASH_SECTOR_ERASE_SIZE);
+            written_sectors++;
+            if (settings.load.verify) {
+                raw_access.read_into_vector(sector, FLASH_SECTOR_ERASE_SIZE, device_buf);
+                if (device_buf != data) {
+                    fail(ERROR_VERIFICATION_FAILED, "The device contents did not match the file at 0x%08x-0x%08x", sector, sector + FLASH_SECTOR_ERASE_SIZE);
+                }
+            }
+        }
+        programmed.insert(sector);
+        pending.erase(p);
+    }
+
+    picoboot::connection &con;
+    picoboot_memory_access &raw_access;
+    std::map<uint32_t, pending_sector> pending;
+    std::set<uint32_t> programmed;
+};
+
+// Load a UF2 or BIN from stdin or a pipe, programming it as it arrives rather than reading it all first
+static bool load_stream(picoboot::connection &con) {
+    if (settings.load.avoid_erase || settings.load.ab || settings.load.staged || settings.load.compress ||
+        settings.load.no_overwrite || settings.load.no_overwrite_force || settings.load.watch) {
+        fail(ERROR_ARGS, "-n, -N, --avoid-erase, --ab, --staged, --compress and --watch cannot be used when loading from a pipe");
+    }
+    auto type = get_file_type();
+    if (type != filetype::uf2 && type != filetype::bin) {
+        fail(ERROR_ARGS, "Only UF2 and BIN files can be loaded from a pipe");
+    }
+    picoboot_memory_access raw_access(con);
+    model_t model = get_model(raw_access);
+    stream_reader reader(settings.filenames[0]);
+
+    // The target partition depends on the family, so for a UF2 read up to the first block of the image before
+    // choosing it; a BIN's family can't be found without all of it
+    vector<uf2_block> first_blocks;
+    uf2_block block;
+    // the same blocks as parsed_image::scan_uf2 loads
+    auto loadable = [](const uf2_block &block) {
+        if (block.magic_start0 != UF2_MAGIC_START0 || block.magic_start1 != UF2_MAGIC_START1 ||
+            block.magic_end != UF2_MAGIC_END || !(block.flags & UF2_FLAG_FAMILY_ID_PRESENT) ||
+            (block.flags & UF2_FLAG_NOT_MAIN_FLASH) || block.payload_size != PAGE_SIZE) {
+            return false;
+        }
+    #if SUPPORT_A2
+        if (check_abs_block(block)) return false;
+    #endif
+        return true;
+    };
+    uint32_t family_id = 0;
+    uint32_t binary_start = settings.offset_set ? settings.offset : FLASH_START;
+    if (type == filetype::uf2) {
+        while (!family_id && reader.read((uint8_t *)&block, sizeof(block)) == sizeof(block)) {
+            first_blocks.push_back(block);
+            if (!loadable(block)) continue;
+            family_id = block.file_size;
+            binary_start = block.target_addr;
+        }
+    }
+    choose_load_partition(con, model, binary_start, [&]() {
+        if (settings.family_id) return settings.family_id;
+        if (type == filetype::bin && model != rp2040) {
+            fail(ERROR_ARGS, "--family, -p or -o must be given to load a BIN from a pipe");
+        }
+        return family_id;
+    });
+    if (settings.offset_set && type != filetype::bin && model == rp2040) {
+        fail(ERROR_ARGS, "Offset only valid for BIN files");
+    }
+
+    uint32_t flash_size = get_flash_size(con, raw_access);
+    sector_assembler assembler(con, raw_access);
+    range_map<size_t> loaded;
+    bool uses_flash = false;
+    // A UF2 for a flash image is moved by the offset as a whole, as for a file whose binary starts at FLASH_START
+    uint32_t rel_offset = type == filetype::uf2 && settings.offset_set ? settings.offset - FLASH_START : 0;
+    auto write = [&](uint32_t address, const uint8_t *data, uint32_t len) {
+        enum memory_type t1 = get_memory_type(address, model);
+        enum memory_type t2 = get_memory_type(address + len, model);
+        if (t1 != t2 || t1 == invalid || t1 == rom || t1 == sram_unstriped) {
+            fail(ERROR_FORMAT, "File to load contained an invalid memory range 0x%08x-0x%08x", address, address + len);
+        }
+        if (t1 == flash) {
+            uses_flash = true;
+            uint32_t flash_end = address + len - FLASH_START;
+            // Skip check when targeting PSRAM, which is anything above 0x11000000
+            if (flash_size && flash_end <= FLASH_END_RP2040 && flash_end > flash_size) {
+                fail(ERROR_NOT_POSSIBLE, "File data at 0x%08x is beyond the end of flash, which is 0x%x bytes", address, flash_size);
+            }
+            if (settings.partition_size && address + len > settings.offset + settings.partition_size) {
+                fail(ERROR_NOT_POSSIBLE, "File data at 0x%08x is beyond the end of the partition, which is 0x%x bytes", address, settings.partition_size);
+            }
+            assembler.add(address, data, len);
+        } else {
+            raw_access.write(address, (uint8_t *)data, len);
+            if (settings.load.verify) {
+                vector<uint8_t> device_buf;
+                raw_access.read_into_vector(address, len, device_buf);
+                if (memcmp(device_buf.data(), data, len)) {
+                    fail(ERROR_VERIFICATION_FAILED, "The device contents did not match the file at 0x%08x-0x%08x", address, address + len);
+                }
+            }
+        }
+        loaded.insert_overwrite(range(address, address + len), 0);
+    };
+
+    if (type == filetype::uf2) {
+        progress_bar bar("Loading from pipe: ");
+        bool warned = false;
+        uint32_t blocks = 0;
+        size_t next_first = 0;
+        auto next_block = [&]() {
+            if (next_first < first_blocks.size()) {
+                block = first_blocks[next_first++];
+                return true;
+            }
+            size_t len = reader.read((uint8_t *)&block, sizeof(block));
+            if (len && len != sizeof(block)) fail(ERROR_READ_FAILED, "unexpected end of input file");
+            return len != 0;
+        };
+        while (next_block()) {
+            if (!loadable(block)) continue;
+            if (block.file_size != family_id) {
+                if (!warned) fos << "WARNING: Multiple family IDs in a single UF2 file - only using first one\n";
+                warned = true;
+                continue;
+            }
+            uint32_t address = block.target_addr;
+            if (rel_offset && get_memory_type(address, model) == flash) address += rel_offset;
+            write(address, block.data, PAGE_SIZE);
+            bar.progress(++blocks, block.num_blocks);
+        }
+        assembler.finish();
+    } else {
+        std::cout << "Loading from pipe...\n";
+        vector<uint8_t> buffer(FLASH_SECTOR_ERASE_SIZE);
+        uint32_t address = binary_start;
+        size_t len;
+        while ((len = reader.read(buffer.data(), buffer.size())) != 0) {
+            write(address, buffer.data(), len);
+            address += len;
+        }
+        assembler.finish();
+    }
+    if (loaded.size() == 0) {
+        fail(ERROR_FORMAT, "The input contained no data to load");
+    }
+    std::cout << "  Read " << reader.bytes_read << " bytes";
+    if (uses_flash) {
+        std::cout << ", and programmed " << assembler.written_sectors << " flash sectors as their data arrived";
+        if (assembler.skipped_sectors) std::cout << " (" << assembler.skipped_sectors << " more were unchanged)";
+    }
+    std::cout << "\n";
+    if (assembler.rewritten_sectors) {
+        std::cout << "  " << assembler.rewritten_sectors << " sectors were programmed again, for data that arrived after they had been written\n";
+    }
+    if (settings.load.execute) {
+        uint32_t start = uses_flash && settings.offset_set ? settings.offset : find_binary_start(loaded);
+        execute_loaded_image(con, start, model);
+        std::cout << "\nThe device was rebooted to start the application.\n";
+        return true;
+    }
+    return false;
+}
+
+bool load_command::execute(device_map &devices) {
+    auto con = get_single_bootsel_device_connection(devices);
+    if (is_stream_input(0)) {
+        return load_stream(con);
+    }
+    picoboot_memory_access raw_access(con);
+    parsed_image image(0);
+    if (image.has_multiple_families()) {
+        fos << "WARNING: Multiple family IDs in a single UF2 file - only using first one\n";
+    }
+    auto tmp_file_access = image.access();
+    choose_load_partition(con, get_model(raw_access), tmp_file_access.get_binary_start(), [&]() {
+        return get_family_id(image);
+    });
+    if (settings.load.ab) {
+        auto partitions = get_partitions(con);
+        if (!partitions) {
+            fail(ERROR_NOT_POSSIBLE, "--ab needs a device with a partition table");
+        }
+        int partition = settings.load.partition;
+        for (unsigned int i = 0; partition < 0 && settings.offset_set && i < partitions->size(); i++) {
+            if (std::get<0>((*partitions)[i]) + FLASH_START == settings.offset) partition = i;
+        }
+        if (partition < 0) {
+            fail(ERROR_NOT_POSSIBLE, "--ab can only be used when loading into a partition");
+        }
+        int partner = get_ab_partner(con, partition);
+        if (partner < 0) {
+            fail(ERROR_NOT_POSSIBLE, "Partition %d is not part of an A/B pair", partition);
+        }
+        settings.load.ab_partner = std::get<0>((*partitions)[partner]) + FLASH_START;
+        settings.load.ab_partner_size = std::get<1>((*partitions)[partner]) - std::get<0>((*partitions)[partner]);
+        printf("  the other slot of the A/B pair is partition %d\n", partner);
+    }
+    auto file_access = image.access();
     if (settings.offset_set && get_file_type() != filetype::bin && get_model(raw_access) == rp2040) {
         fail(ERROR_ARGS, "Offset only valid for BIN files");
     }
+    model_t model = get_model(raw_access);
     bool ret = load_guts(con, file_access);
+    if (settings.load.watch) {
+        watch_and_load(devices, con, file_access, model, ret);
+    }
     return ret;
 }
 #endif
@@ -4967,6 +7415,24 @@ uint32_t __noinline otp_calculate_ecc(uint16_t x) {
 
 
 #if HAS_MBEDTLS
+// Write file 1 as a copy of the UF2 in file 0, with the image for family_id replaced - see uf2_patch_family
+void write_patched_uf2(uint32_t family_id, uint32_t address, const vector<uint8_t> &image) {
+    auto in = get_file_idx(ios::in|ios::binary, 0);
+    if (same_file_idx(0, 1)) {
+        // Can't stream over the input, so build the output in memory first
+        auto tmp = std::make_shared<std::stringstream>();
+        uf2_patch_family(in, tmp, family_id, address, image, settings.uf2.abs_block_loc, settings.verbose);
+        in->close();
+        auto out = get_file_idx(ios::out|ios::binary, 1);
+        *out << tmp->rdbuf();
+        out->close();
+    } else {
+        auto out = get_file_idx(ios::out|ios::binary, 1);
+        uf2_patch_family(in, out, family_id, address, image, settings.uf2.abs_block_loc, settings.verbose);
+        out->close();
+    }
+}
+
 void sign_guts_elf(elf_file* elf, private_t private_key, public_t public_key) {
     std::unique_ptr<block> first_block = find_first_block(elf);
     if (!first_block) {
@@ -5052,8 +7518,8 @@ void sign_guts_elf(elf_file* elf, private_t private_key, public_t public_key) {
     );
 }
 
-vector<uint8_t> sign_guts_bin(iostream_memory_access in, private_t private_key, public_t public_key, uint32_t bin_start, uint32_t bin_size) {
-    vector<uint8_t> bin = in.read_vector<uint8_t>(bin_start, bin_size, false);
+vector<uint8_t> sign_guts_bin(iostream_memory_access in, private_t private_key, public_t public_key, uint32_t bin_start, uint32_t bin_size, bool zero_fill = false) {
+    vector<uint8_t> bin = in.read_vector<uint8_t>(bin_start, bin_size, zero_fill);
 
     std::unique_ptr<block> first_block = find_first_block(bin, bin_start);
     if (!first_block) {
@@ -5122,6 +7588,7 @@ vector<uint8_t> sign_guts_bin(iostream_memory_access in, private_t private_key,
 bool encrypt_command::execute(device_map &devices) {
     bool isElf = false;
     bool isBin = false;
+    bool isUf2 = false;
 
     bool keyFromFile = true;
     bool keyIsShare = false;
@@ -5139,8 +7606,13 @@ bool encrypt_command::execute(device_map &devices) {
             fail(ERROR_ARGS, "Can only embed decrypting bootloader into ELFs");
         }
         isBin = true;
+    } else if (get_file_type() == filetype::uf2) {
+        if (settings.encrypt.embed) {
+            fail(ERROR_ARGS, "Can only embed decrypting bootloader into ELFs");
+        }
+        isUf2 = true;
     } else {
-        fail(ERROR_ARGS, "Can only sign ELFs or BINs");
+        fail(ERROR_ARGS, "Can only sign ELFs, BINs or UF2s");
     }
 
     if (get_file_type_idx(1) != get_file_type()) {
@@ -5415,19 +7887,18 @@ bool encrypt_command::execute(device_map &devices) {
             out->close();
         } else {
             encrypt(elf, &new_block, aes_key, public_key, private_key, iv_salt, settings.seal.hash, settings.seal.sign);
-            auto out = get_file_idx(ios::out|ios::binary, 1);
-            elf->write(out);
-            out->close();
+            elf->write_incremental(settings.filenames[1], settings.filenames[0]);
         }
-    } else if (isBin) {
+    } else if (isBin || isUf2) {
         auto binfile = get_file_memory_access(0);
         auto rmap = binfile.get_rmap();
         auto ranges = rmap.ranges();
-        assert(ranges.size() == 1);
-        auto bin_start = ranges[0].from;
-        auto bin_size = ranges[0].len();
+        assert(isUf2 || ranges.size() == 1);
+        auto bin_start = ranges.front().from;
+        auto bin_size = ranges.back().to - bin_start;
 
-        vector<uint8_t> bin = binfile.read_vector<uint8_t>(bin_start, bin_size, false);
+        // UF2s may be sparse, so read any gaps as zeros
+        vector<uint8_t> bin = binfile.read_vector<uint8_t>(bin_start, bin_size, isUf2);
 
         std::unique_ptr<block> first_block = find_first_block(bin, bin_start);
         if (!first_block) {
@@ -5444,11 +7915,15 @@ bool encrypt_command::execute(device_map &devices) {
 
         auto enc_data = encrypt(bin, bin_start, bin_start, &new_block, aes_key, public_key, private_key, iv_salt, settings.seal.hash, settings.seal.sign);
 
-        auto out = get_file_idx(ios::out|ios::binary, 1);
-        out->write((const char *)enc_data.data(), enc_data.size());
-        out->close();
+        if (isUf2) {
+            write_patched_uf2(get_family_id(0), bin_start, enc_data);
+        } else {
+            auto out = get_file_idx(ios::out|ios::binary, 1);
+            out->write((const char *)enc_data.data(), enc_data.size());
+            out->close();
+        }
     } else {
-        fail(ERROR_ARGS, "Must be ELF or BIN");
+        fail(ERROR_ARGS, "Must be ELF, BIN or UF2");
     }
 
     if (!settings.filenames[5].empty()) {
@@ -5648,9 +8123,8 @@ bool seal_command::execute(device_map &devices) {
         elf->remove_sh_holes();
         sign_guts_elf(elf, private_key, public_key);
 
-        auto out = get_file_idx(ios::out|ios::binary, 1);
-        elf->write(out);
-        out->close();
+        // Only the new block and headers change, so patch a copy of the input rather than rewriting it all
+        elf->write_incremental(settings.filenames[1], settings.filenames[0]);
     } else if (isBin) {
         auto access = get_file_memory_access(0);
         auto rmap = access.get_rmap();
@@ -5671,14 +8145,11 @@ bool seal_command::execute(device_map &devices) {
         auto bin_size = ranges.back().to - bin_start;
         auto family_id = get_family_id(0);
 
-        auto sig_data = sign_guts_bin(access, private_key, public_key, bin_start, bin_size);
-        auto tmp = std::make_shared<std::stringstream>();
-        tmp->write(reinterpret_cast<const char*>(sig_data.data()), sig_data.size());
-        auto out = get_file_idx(ios::out|ios::binary, 1);
-        bin2uf2(tmp, out, bin_start, family_id, settings.uf2.abs_block_loc);
-        out->close();
+        // Sign the sparse image (with any gaps as zeros), then only rewrite the UF2 blocks that change
+        auto sig_data = sign_guts_bin(access, private_key, public_key, bin_start, bin_size, true);
+        write_patched_uf2(family_id, bin_start, sig_data);
     } else {
-        fail(ERROR_ARGS, "Must be ELF or BIN");
+        fail(ERROR_ARGS, "Must be ELF, BIN or UF2");
     }
 
     if (settings.seal.sign) {
@@ -5733,58 +8204,72 @@ bool seal_command::execute(device_map &devices) {
 
     return false;
 }
-#endif
-
-bool link_command::execute(device_map &devices) {
-    if (get_file_type() != filetype::bin) {
-        fail(ERROR_ARGS, "Can only link to BINs");
-    }
-
-    if (__builtin_popcount(settings.link.align) != 1) {
-        fail(ERROR_ARGS, "Can only pad to powers of 2");
-    }
-
-    vector<uint8_t> output;
-    vector<std::unique_ptr<block>> first_blocks;
-    for (size_t i=1; i < settings.filenames.size(); i++) {
-        if (settings.filenames[i].empty()) break;
-        if (get_file_type_idx(i) != filetype::bin) {
-            fail(ERROR_ARGS, "Can only link BINs");
-        }
-
-        auto access = get_file_memory_access(i);
-        auto rmap = access.get_rmap();
-        auto ranges = rmap.ranges();
-        assert(ranges.size() == 1);
-        auto bin_start = ranges[0].from;
-        auto bin_size = ranges[0].len();
-
-        vector<uint8_t> bin = access.read_vector<uint8_t>(bin_start, bin_size, false);
+#endif
 
-        std::unique_ptr<block> first_block = find_first_block(bin, bin_start);
-        if (!first_block) {
-            fail(ERROR_FORMAT, "No first block found");
-        }
+bool link_command::execute(device_map &devices) {
+    bool isUf2 = get_file_type() == filetype::uf2;
+    if (!isUf2 && get_file_type() != filetype::bin) {
+        fail(ERROR_ARGS, "Can only link to BINs or UF2s");
+    }
 
-        first_blocks.push_back(std::move(first_block));
+    if (__builtin_popcount(settings.link.align) != 1) {
+        fail(ERROR_ARGS, "Can only pad to powers of 2");
     }
 
-    for (size_t i=0; i < first_blocks.size(); i++) {
-        auto access = get_file_memory_access(i+1);
-        auto rmap = access.get_rmap();
+    // Each input is parsed once up front, to work out the layout and how the block loops are relinked, then the
+    // output is streamed out image by image, so none of the images need to be held in memory
+    struct link_image {
+        explicit link_image(iostream_memory_access access) : access(access) {}
+        iostream_memory_access access;
+        uint32_t bin_start = 0;
+        uint32_t bin_size = 0;
+        std::unique_ptr<block> first_block;
+        std::unique_ptr<block> new_block;
+        uint32_t patch_offset = 0;
+        uint32_t patch_value = 0;
+        vector<uint8_t> block_data;
+        uint32_t padded_size = 0;
+    };
+    vector<link_image> images;
+    for (size_t i=1; i < settings.filenames.size(); i++) {
+        if (settings.filenames[i].empty()) break;
+        if (same_file_idx(0, i)) {
+            fail(ERROR_ARGS, "Cannot link to one of the input files");
+        }
+        auto type = get_file_type_idx(i);
+        if (type != filetype::bin && type != filetype::elf && type != filetype::uf2) {
+            fail(ERROR_ARGS, "Can only link BINs, ELFs or UF2s");
+        }
+        auto file = get_file_idx(ios::in|ios::binary, i);
+        images.emplace_back(get_iostream_memory_access<iostream_memory_access>(file, type));
+        auto &image = images.back();
+        auto rmap = image.access.get_rmap();
         auto ranges = rmap.ranges();
-        assert(ranges.size() == 1);
-        auto bin_start = ranges[0].from;
-        auto bin_size = ranges[0].len();
-
-        vector<uint8_t> bin = access.read_vector<uint8_t>(bin_start, bin_size, false);
+        if (ranges.empty()) {
+            fail(ERROR_FORMAT, "'%s' has no data to link", settings.filenames[i].c_str());
+        }
+        image.bin_start = ranges.front().from;
+        image.bin_size = ranges.back().to - image.bin_start;
 
-        std::unique_ptr<block> first_block = find_first_block(bin, bin_start);
-        if (!first_block) {
+        // The first block must be in the first 4K
+        vector<uint8_t> bin = image.access.read_vector<uint8_t>(image.bin_start, std::min(image.bin_size, 0x1000u), true);
+        image.first_block = find_first_block(bin, image.bin_start);
+        if (!image.first_block) {
             fail(ERROR_FORMAT, "No first block found");
         }
+    }
 
-        auto last_block = get_last_block(bin, bin_start, first_block);
+    uint32_t output_size = 0;
+    for (size_t i=0; i < images.size(); i++) {
+        auto &image = images[i];
+        auto &access = image.access;
+        get_more_bin_cb more_cb = [&access](std::vector<uint8_t> &bin, uint32_t offset, uint32_t size) {
+            DEBUG_LOG("Now reading from %x size %x\n", offset, size);
+            bin = access.read_vector<uint8_t>(offset, size, true);
+        };
+        std::unique_ptr<block> first_block = std::unique_ptr<block>(new block(*image.first_block));
+        vector<uint8_t> bin;
+        auto last_block = get_last_block(bin, image.bin_start, first_block, more_cb);
         if (last_block == nullptr || last_block->get_item<image_type_item>() == nullptr) {
             // Use first block instead of last block, as last block doesn't have an image_def
             first_block.swap(last_block);
@@ -5792,55 +8277,89 @@ bool link_command::execute(device_map &devices) {
         }
 
         // Use last block items in new block
-        block new_block = place_new_block(bin, bin_start, first_block);
+        image.new_block = std::unique_ptr<block>(new block(place_new_block(image.bin_start, image.bin_size, first_block, more_cb, image.patch_offset, image.patch_value)));
+        auto &new_block = *image.new_block;
         new_block.items.clear();
         std::copy(last_block->items.begin(),
             last_block->items.end(),
             std::back_inserter(new_block.items));
 
-        if (output.size() > 0) {
+        if (output_size > 0) {
             // Add rwd to block, if required
-            fos_verbose << "Adding rwd, as output is size " << hex_string(output.size()) << "\n";
-            std::shared_ptr<rolling_window_delta_item> rwd = std::make_shared<rolling_window_delta_item>(output.size());
+            fos_verbose << "Adding rwd, as output is size " << hex_string(output_size) << "\n";
+            std::shared_ptr<rolling_window_delta_item> rwd = std::make_shared<rolling_window_delta_item>(output_size);
             new_block.items.push_back(rwd);
 
             if (last_block->get_item<image_type_item>()->cpu() == cpu_arm && last_block->get_item<vector_table_item>() == nullptr) {
                 // Add vtor too
                 fos_verbose << "Adding vtor too\n";
-                std::shared_ptr<vector_table_item> vtor = std::make_shared<vector_table_item>(bin_start);
+                std::shared_ptr<vector_table_item> vtor = std::make_shared<vector_table_item>(image.bin_start);
                 new_block.items.push_back(vtor);
             }
         }
 
-        // Link new block to next first block
-        if (i+1 != first_blocks.size()) {
-            auto next_first_block_rel = (first_blocks[i+1]->physical_addr - bin_start) + (settings.link.align - bin.size() % settings.link.align);
-            new_block.next_block_rel = next_first_block_rel;
+        // The block is a fixed size, whatever it ends up linking to
+        image.block_data.resize(new_block.to_words().size() * 4);
+        fos_verbose << "Size before block: " << hex_string(image.bin_size) << "\n";
+        fos_verbose << "Size after block: " << hex_string(image.bin_size + image.block_data.size()) << "\n";
+        image.padded_size = (image.bin_size + image.block_data.size() + settings.link.align - 1) & ~(settings.link.align - 1);
+        fos_verbose << "Size after padding: " << hex_string(image.padded_size) << "\n";
+        output_size += image.padded_size;
+    }
+
+    // Link each new block to the next image's first block, and the last one back to the start
+    uint32_t output_offset = 0;
+    for (size_t i=0; i < images.size(); i++) {
+        auto &image = images[i];
+        if (i+1 != images.size()) {
+            auto next_first_block_rel = (images[i+1].first_block->physical_addr - image.bin_start) + (settings.link.align - image.bin_size % settings.link.align);
+            image.new_block->next_block_rel = next_first_block_rel;
         } else {
-            auto next_first_block_rel = (first_blocks[0]->physical_addr - bin_start) - (output.size() + bin.size());
-            new_block.next_block_rel = next_first_block_rel;
+            auto next_first_block_rel = (images[0].first_block->physical_addr - image.bin_start) - (output_offset + image.bin_size);
+            image.new_block->next_block_rel = next_first_block_rel;
         }
+        auto tmp = image.new_block->to_words();
+        image.block_data = words_to_lsb_bytes(tmp.begin(), tmp.end());
+        output_offset += image.padded_size;
+    }
 
-        // Add new block to bin
-        fos_verbose << "Size before block: " << hex_string(bin.size()) << "\n";
-        auto tmp = new_block.to_words();
-        std::vector<uint8_t> data = words_to_lsb_bytes(tmp.begin(), tmp.end());
-        bin.insert(bin.end(), data.begin(), data.end());
-        fos_verbose << "Size after block: " << hex_string(bin.size()) << "\n";
+    auto out = get_file_idx(ios::out|ios::binary, 0);
+    std::unique_ptr<uf2_stream_writer> uf2_out;
+    if (isUf2) {
+        uint32_t family_id = settings.family_id ? settings.family_id : get_access_family_id(images[0].access);
+        uf2_out.reset(new uf2_stream_writer(out, images[0].bin_start, output_size, family_id));
+    }
+    auto write_out = [&](const uint8_t *data, size_t len) {
+        if (uf2_out) {
+            uf2_out->write(data, len);
+        } else {
+            out->write((const char *)data, len);
+            if (out->fail()) {
+                fail(ERROR_WRITE_FAILED, "Write to file failed");
+            }
+        }
+    };
 
+    const uint32_t chunk_size = 0x10000;
+    vector<uint8_t> chunk;
+    for (auto &image : images) {
+        for (uint32_t pos = 0; pos < image.bin_size; pos += chunk.size()) {
+            image.access.read_into_vector(image.bin_start + pos, std::min(chunk_size, image.bin_size - pos), chunk, true);
+            // Relink the old end of the block loop to the new block
+            for (uint32_t i = 0; i < 4; i++) {
+                uint32_t offset = image.patch_offset + i;
+                if (offset >= pos && offset < pos + chunk.size()) {
+                    chunk[offset - pos] = (image.patch_value >> (8 * i)) & 0xff;
+                }
+            }
+            write_out(chunk.data(), chunk.size());
+        }
+        write_out(image.block_data.data(), image.block_data.size());
         // Pad 0s in between binaries
-        fos_verbose << "Size before padding: " << hex_string(bin.size()) << "\n";
-        bin.resize((bin.size() + settings.link.align -1) & ~(settings.link.align -1), 0);
-        fos_verbose << "Size after padding: " << hex_string(bin.size()) << "\n";
-
-        // Copy into output
-        std::copy(bin.begin(),
-              bin.end(),
-              std::back_inserter(output));
+        chunk.assign(image.padded_size - image.bin_size - image.block_data.size(), 0);
+        if (!chunk.empty()) write_out(chunk.data(), chunk.size());
     }
-
-    auto out = get_file_idx(ios::out|ios::binary, 0);
-    out->write((const char *)output.data(), output.size());
+    if (uf2_out) uf2_out->finish();
     out->close();
 
     return false;
@@ -5863,6 +8382,11 @@ bool verify_command::execute(device_map &devices) {
         }
     }
     ranges.erase(std::remove_if(ranges.begin(), ranges.end(), std::mem_fn(&range::empty)), ranges.end());
+    // the blank sector helper can't be used if it would overwrite SRAM that is to be verified
+    auto helper_sram = blank_sector_map::sram_used();
+    bool use_blank_map = std::none_of(ranges.begin(), ranges.end(), [&](const range &r) {
+        return r.from < helper_sram.to && helper_sram.from < r.to;
+    });
     if (ranges.empty()) {
         std::cout << "No ranges to verify.\n";
     } else {
@@ -5874,6 +8398,11 @@ bool verify_command::execute(device_map &devices) {
             } else {
                 bool ok = true;
                 uint32_t pos = mem_range.from;
+                // erased sectors are found on the device, so that they don't need to be read
+                std::unique_ptr<blank_sector_map> blank_map;
+                if (t1 == flash && use_blank_map) {
+                    blank_map = blank_sector_map::create(con, raw_access, mem_range);
+                }
                 {
                     progress_bar bar("Verifying " + memory_names[t1] + ": ");
                     vector<uint8_t> file_buf;
@@ -5885,7 +8414,13 @@ bool verify_command::execute(device_map &devices) {
                         // mean that the verification will fail if those holes are not filled with zeros
                         // on the device
                         file_access.read_into_vector(base, this_batch, file_buf, true);
-                        raw_access.read_into_vector(base, this_batch, device_buf);
+                        if (blank_map) {
+                            blank_map->read(base, this_batch, device_buf, [&](uint32_t addr, uint32_t len, vector<uint8_t> &data) {
+                                raw_access.read_into_vector(addr, len, data);
+                            });
+                        } else {
+                            raw_access.read_into_vector(base, this_batch, device_buf);
+                        }
                         assert(file_buf.size() == device_buf.size());
                         for(unsigned int i=0;i<this_batch;i++) {
                             if (file_buf[i] != device_buf[i]) {
@@ -6107,15 +8642,23 @@ bool get_mask(const std::string& sel, uint32_t &mask, int max_bit) {
     return false;
 }
 
-void init_matches(const otp_reg *reg, uint32_t reg_row, const std::string& field_sel, int max_bit,
-                  std::function<void(otp_match)> func, bool fuzzy = true) {
-    if (!reg) {
-        auto f = otp_regs.find(reg_row);
-        if (f != otp_regs.end()) {
-            reg = &f->second;
+// Parses a bit index or bit range field selector into a mask; returns false if it is a field name instead
+static bool get_field_sel_mask(const std::string& field_sel, uint32_t &mask, int max_bit) {
+    int from = 0;
+    if (get_mask(field_sel, mask, max_bit)) return true;
+    if (get_int(field_sel, from)) {
+        if (from < 0 || from >= max_bit) {
+            fail(ERROR_ARGS, "Invalid bit-index in selector: %s; expect value from 0 to %d", field_sel.c_str(), max_bit - 1);
         }
+        mask = 1u << from;
+        return true;
     }
-    std::vector<otp_match> matches;
+    return false;
+}
+
+void init_matches(const otp_reg *reg, uint32_t reg_row, const std::string& field_sel, int max_bit,
+                  std::function<void(otp_match)> func, bool fuzzy = true) {
+    if (!reg) reg = otp_regs.find(reg_row);
     otp_match m;
     m.reg_row = reg_row;
     m.reg = reg;
@@ -6124,41 +8667,64 @@ void init_matches(const otp_reg *reg, uint32_t reg_row, const std::string& field
     if (field_sel.empty()) {
         if (reg) m.mask = reg->mask;
         else m.mask = 0xffffffff;
-    } else {
-        int from = 0;
-        if (!get_mask(field_sel, m.mask, max_bit)) {
-            if (get_int(field_sel, from)) {
-                if (from < 0 || from >= max_bit) {
-                    fail(ERROR_ARGS, "Invalid bit-index in selector: %s; expect value from 0 to %d", field_sel.c_str(), max_bit - 1);
-                }
-                m.mask = 1u << from;
-            } else if (reg) {
-                // field name
-                auto upper_field = uppercase(field_sel);
-                for(const auto &f : reg->fields) {
-                    if (f.upper_name.find(upper_field) != string::npos && fuzzy) {
-                        m.field = &f;
-                        m.mask = f.mask;
-                        func(m);
-                        m.mask = 0;
-                    } else if (f.upper_name == upper_field) {
-                        m.field = &f;
-                        m.mask = f.mask;
-                        func(m);
-                        m.mask = 0;
-                    }
-                }
+    } else if (!get_field_sel_mask(field_sel, m.mask, max_bit) && reg) {
+        // field name
+        auto upper_field = uppercase(field_sel);
+        for(const auto &f : reg->fields) {
+            if (f.upper_name.find(upper_field) != string::npos && fuzzy) {
+                m.field = &f;
+                m.mask = f.mask;
+                func(m);
+                m.mask = 0;
+            } else if (f.upper_name == upper_field) {
+                m.field = &f;
+                m.mask = f.mask;
+                func(m);
+                m.mask = 0;
             }
         }
     }
     if (m.mask) func(m);
 }
 
+// Same as calling init_matches(nullptr, row, field_sel, ...) for every row in [begin_row, end_row), but walks
+// the registers in the range alongside the rows rather than looking each one up, and parses field_sel only once
+void init_range_matches(uint32_t begin_row, uint32_t end_row, const std::string& field_sel, int max_bit,
+                        const std::function<void(otp_match)> &func) {
+    uint32_t mask = 0;
+    if (!field_sel.empty() && !get_field_sel_mask(field_sel, mask, max_bit)) {
+        // a field name can only match rows with a known register
+        otp_regs.for_each(begin_row, end_row, [&](const otp_reg &reg) {
+            init_matches(&reg, reg.row, field_sel, max_bit, func);
+        });
+        return;
+    }
+    std::vector<const otp_reg *> regs;
+    otp_regs.for_each(begin_row, end_row, [&](const otp_reg &reg) { regs.push_back(&reg); });
+    auto it = regs.begin();
+    otp_match m;
+    m.field = nullptr;
+    for (uint32_t row = begin_row; row < end_row; row++) {
+        m.reg_row = row;
+        m.reg = nullptr;
+        if (it != regs.end() && (*it)->row == row) {
+            m.reg = *it;
+            it++;
+        }
+        if (field_sel.empty()) {
+            m.mask = m.reg ? m.reg->mask : 0xffffffff;
+        } else {
+            m.mask = mask;
+        }
+        if (m.mask) func(m);
+    }
+}
+
 std::map<std::pair<uint32_t,uint32_t>, otp_match> filter_otp(std::vector<string> selectors, int max_bit, bool fuzzy) {
-    // inefficient but who cares!?
     std::map<std::pair<uint32_t,uint32_t>, otp_match> matches;
     auto match_adder = [&matches](const otp_match &m) {
-        matches.emplace(std::make_pair(m.reg_row, m.mask), m);
+        // matches mostly arrive in row order
+        matches.emplace_hint(matches.end(), std::make_pair(m.reg_row, m.mask), m);
     };
     for(const auto &sel : selectors) {
         std::string reg_sel;
@@ -6196,10 +8762,12 @@ std::map<std::pair<uint32_t,uint32_t>, otp_match> filter_otp(std::vector<string>
                 std::string offset_sel = reg_sel.substr(colon + 1);
                 int page_row = 0;
                 if (offset_sel.empty()) {
-                    for(auto page : pages) {
-                        for (reg_row = page * OTP_PAGE_ROWS; reg_row < (page + 1) * OTP_PAGE_ROWS; reg_row++) {
-                            init_matches(nullptr, reg_row, field_sel, max_bit, match_adder);
-                        }
+                    // pages are consecutive, so a whole run of them is one row range
+                    for (size_t i = 0; i < pages.size();) {
+                        size_t j = i + 1;
+                        while (j < pages.size() && pages[j] == pages[j - 1] + 1) j++;
+                        init_range_matches(pages[i] * OTP_PAGE_ROWS, (pages[j - 1] + 1) * OTP_PAGE_ROWS, field_sel, max_bit, match_adder);
+                        i = j;
                     }
                 } else if (!get_int(offset_sel, page_row) || page_row < 0 || page_row >= OTP_PAGE_ROWS) {
                     fail(ERROR_ARGS, "Invalid selector %s; page row number must be even and between 0 and 0x%x", sel.c_str(), OTP_PAGE_ROWS);
@@ -6210,11 +8778,18 @@ std::map<std::pair<uint32_t,uint32_t>, otp_match> filter_otp(std::vector<string>
                 }
             } else {
                 auto upper = uppercase(reg_sel);
-                for(const auto &e : otp_regs) {
-                    if (e.second.upper_name.find(upper, 0) != string::npos && fuzzy) {
-                        init_matches(&e.second, e.second.row, field_sel, max_bit, match_adder);
-                    } else if (e.second.upper_name == upper || e.second.upper_name == "OTP_DATA_" + upper) {
-                        init_matches(&e.second, e.second.row, field_sel, max_bit, match_adder, false);
+                if (fuzzy) {
+                    // an exact match is also a substring match
+                    for (auto row : otp_regs.rows_containing(upper)) {
+                        init_matches(otp_regs.find(row), row, field_sel, max_bit, match_adder);
+                    }
+                } else {
+                    auto a = otp_regs.rows_named(upper);
+                    auto b = otp_regs.rows_named("OTP_DATA_" + upper);
+                    std::vector<uint32_t> named;
+                    std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(named));
+                    for (auto row : named) {
+                        init_matches(otp_regs.find(row), row, field_sel, max_bit, match_adder, false);
                     }
                 }
             }
@@ -6625,10 +9200,9 @@ bool uf2_convert_command::execute(device_map &devices) {
         fail(ERROR_ARGS, "Output must be a UF2 file\n");
     }
 
-    uint32_t family_id = get_family_id(0);
-
-    auto in = get_file(ios::in|ios::binary);
-    auto out = get_file_idx(ios::out|ios::binary, 1);
+    if (get_file_type() != filetype::elf && get_file_type() != filetype::bin) {
+        fail(ERROR_ARGS, "Convert currently only from ELF/BIN to UF2\n");
+    }
     #if SUPPORT_A2
     // RP2350-E10 : add absolute block
     if (settings.uf2.abs_block) {
@@ -6637,14 +9211,47 @@ bool uf2_convert_command::execute(device_map &devices) {
         settings.uf2.abs_block_loc = 0;
     }
     #endif
+
+    // A cached conversion is keyed on the options that change the output; the detected family follows from the contents
+    auto cache = conversion_cache::open();
+    conversion_cache::input_id id;
+    if (cache) {
+        id = cache->identify(0, {(uint32_t)get_file_type(), settings.family_id, settings.offset_set, settings.offset,
+                                 settings.uf2.abs_block_loc});
+    }
+    auto cached = id.key ? cache->find(id) : nullptr;
+    if (cached) {
+        auto out = get_file_idx(ios::out|ios::binary, 1);
+        out->write((const char *)cached->uf2, cached->uf2_size);
+        out->close();
+        if (out->fail()) {
+            fail(ERROR_WRITE_FAILED, "Failed to write output file");
+        }
+        return false;
+    }
+
+    uint32_t family_id = get_family_id(0);
+
+    auto in = get_file(ios::in|ios::binary);
+    auto out = get_file_idx(ios::out|ios::binary, 1);
+    // When caching, convert into memory, so the result can be stored as well as written
+    std::shared_ptr<std::stringstream> converted = id.key ? std::make_shared<std::stringstream>() : nullptr;
+    std::shared_ptr<std::iostream> uf2_out = converted ? std::static_pointer_cast<std::iostream>(converted) : out;
     if (get_file_type() == filetype::elf) {
         uint32_t package_address = settings.offset_set ? settings.offset : 0;
-        elf2uf2(in, out, family_id, package_address, settings.uf2.abs_block_loc, settings.verbose);
-    } else if (get_file_type() == filetype::bin) {
-        uint32_t address = settings.offset_set ? settings.offset : FLASH_START;
-        bin2uf2(in, out, address, family_id, settings.uf2.abs_block_loc, settings.verbose);
+        elf2uf2(in, uf2_out, family_id, package_address, settings.uf2.abs_block_loc, settings.verbose);
     } else {
-        fail(ERROR_ARGS, "Convert currently only from ELF/BIN to UF2\n");
+        uint32_t address = settings.offset_set ? settings.offset : FLASH_START;
+        bin2uf2(in, uf2_out, address, family_id, settings.uf2.abs_block_loc, settings.verbose);
+    }
+    if (converted) {
+        string uf2 = converted->str();
+        conversion_cache::entry e;
+        e.family_id = family_id;
+        e.uf2 = (const uint8_t *)uf2.data();
+        e.uf2_size = uf2.size();
+        cache->store(id, e);
+        out->write(uf2.data(), uf2.size());
     }
     out->close();
 
@@ -7556,40 +10163,385 @@ static void hack_init_otp_regs() {
 }
 
 
+// The OTP an otp command works on; either a device, or an image file given with --image. Reads and writes
+// take the same arguments as the PICOBOOT OTP commands, and fail in the same way (with a
+// picoboot::command_failure)
+struct otp_access {
+    virtual ~otp_access() = default;
+    virtual void read(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) = 0;
+    virtual void write(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) = 0;
+    // Saves any changes, for targets which need it
+    virtual void flush() {}
+};
+
+struct picoboot_otp_access : public otp_access {
+    explicit picoboot_otp_access(std::unique_ptr<picoboot::connection> con) : con(std::move(con)) {}
+
+    void read(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) override {
+        con->otp_read(otp_cmd, buffer, len);
+    }
+
+    void write(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) override {
+        con->otp_write(otp_cmd, buffer, len);
+    }
+
+    std::unique_ptr<picoboot::connection> con;
+};
+
+// An OTP image held in memory; the file is OTP_ROW_COUNT raw 24-bit rows at 4 bytes per row, as written by
+// 'otp dump --output'. An ECC dump (2 bytes per row) is also accepted, and converted to raw rows. Writes follow
+// the device's rules: ECC rows can only be written when blank, and raw rows can only have bits set.
+struct file_otp_access : public otp_access {
+    explicit file_otp_access(const string &filename, bool create) : filename(filename), rows(OTP_ROW_COUNT) {
+        std::ifstream in(filename, ios::in|ios::binary);
+        if (!in.good()) {
+            if (!create) fail(ERROR_READ_FAILED, "Could not open OTP image %s", filename.c_str());
+            dirty = true;
+            return;
+        }
+        vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (data.size() == OTP_ROW_COUNT * 4) {
+            memcpy(rows.data(), data.data(), data.size());
+        } else if (data.size() == OTP_ROW_COUNT * 2) {
+            for (int i = 0; i < OTP_ROW_COUNT; i++) {
+                rows[i] = otp_calculate_ecc(data[i * 2] | (data[i * 2 + 1] << 8));
+            }
+        } else {
+            fail(ERROR_FORMAT, "OTP image %s must be %d (raw) or %d (ECC) bytes", filename.c_str(), OTP_ROW_COUNT * 4, OTP_ROW_COUNT * 2);
+        }
+    }
+
+    void read(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) override {
+        uint32_t row_size = check(otp_cmd, len);
+        for (uint32_t i = 0; i < otp_cmd->wRowCount; i++) {
+            uint32_t value = rows[otp_cmd->wRow + i] & 0xffffff;
+            memcpy(buffer + i * row_size, &value, row_size);
+        }
+    }
+
+    void write(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) override {
+        uint32_t row_size = check(otp_cmd, len);
+        vector<uint32_t> values(otp_cmd->wRowCount);
+        for (uint32_t i = 0; i < otp_cmd->wRowCount; i++) {
+            uint32_t value = 0;
+            memcpy(&value, buffer + i * row_size, row_size);
+            uint32_t old_value = rows[otp_cmd->wRow + i] & 0xffffff;
+            if (otp_cmd->bEcc) {
+                value = otp_calculate_ecc(value);
+                if (old_value && old_value != value) throw picoboot::command_failure(PICOBOOT_UNSUPPORTED_MODIFICATION);
+            } else {
+                value &= 0xffffff;
+                if (old_value & ~value) throw picoboot::command_failure(PICOBOOT_UNSUPPORTED_MODIFICATION);
+            }
+            values[i] = value;
+        }
+        // only update once the whole write has been checked
+        std::copy(values.begin(), values.end(), rows.begin() + otp_cmd->wRow);
+        dirty = true;
+    }
+
+    void flush() override {
+        if (!dirty) return;
+        std::ofstream out(filename, ios::out|ios::binary|ios::trunc);
+        out.write((const char *)rows.data(), rows.size() * sizeof(rows[0]));
+        if (!out.good()) fail(ERROR_WRITE_FAILED, "Could not write OTP image %s", filename.c_str());
+        dirty = false;
+    }
+
+private:
+    static uint32_t check(const struct picoboot_otp_cmd *otp_cmd, uint32_t len) {
+        uint32_t row_size = otp_cmd->bEcc ? 2 : 4;
+        if (otp_cmd->wRow + otp_cmd->wRowCount > OTP_ROW_COUNT || len != otp_cmd->wRowCount * row_size) {
+            throw picoboot::command_failure(PICOBOOT_BAD_ALIGNMENT);
+        }
+        return row_size;
+    }
+
+    string filename;
+    vector<uint32_t> rows;
+    bool dirty = false;
+};
+
+// create is for commands that write, which can start from a blank image
+static std::unique_ptr<otp_access> get_otp_access(device_map &devices, bool exclusive, bool create = false) {
+    if (!settings.otp.image.empty()) {
+        return std::unique_ptr<otp_access>(new file_otp_access(settings.otp.image, create));
+    }
+    std::unique_ptr<picoboot::connection> con(new picoboot::connection(get_single_rp2350_bootsel_device_connection(devices, exclusive)));
+    return std::unique_ptr<otp_access>(new picoboot_otp_access(std::move(con)));
+}
+
+// Reads OTP rows in as few PICOBOOT commands as possible. Each range is first read with a single command, and
+// if that is not permitted it is split in half until the unreadable rows are isolated; permissions are per
+// page outside the special (lock) pages, so a single unreadable normal page is not split further. Unreadable
+// rows are remembered, so later reads through the same reader skip them.
+struct otp_reader {
+    explicit otp_reader(otp_access &otp) : otp(otp) {}
+
+    // Reads rows [row, row + count) into buffer at 2 (ecc) or 4 bytes per row, returning the rows that were not
+    // permitted; their part of the buffer is left as it was
+    std::set<uint32_t> read(uint32_t row, uint32_t count, bool ecc, uint8_t *buffer) {
+        std::set<uint32_t> failed;
+        uint32_t row_size = ecc ? 2 : 4;
+        uint32_t end = row + count;
+        for (uint32_t from = row; from < end;) {
+            auto bad = not_permitted.lower_bound(from);
+            uint32_t to = bad == not_permitted.end() ? end : std::min(end, *bad);
+            if (to > from) {
+                read_range(from, to - from, ecc, buffer + (from - row) * row_size, failed);
+            }
+            if (to < end) failed.insert(to);
+            from = to + 1;
+        }
+        return failed;
+    }
+
+    uint32_t commands = 0;
+
+private:
+    void read_range(uint32_t row, uint32_t count, bool ecc, uint8_t *buffer, std::set<uint32_t> &failed) {
+        struct picoboot_otp_cmd otp_cmd;
+        otp_cmd.wRow = row;
+        otp_cmd.wRowCount = count;
+        otp_cmd.bEcc = ecc;
+        try {
+            commands++;
+            otp.read(&otp_cmd, buffer, count * (ecc ? 2 : 4));
+            return;
+        } catch (picoboot::command_failure &e) {
+            if (e.get_code() != PICOBOOT_NOT_PERMITTED) throw;
+        }
+        uint32_t end = row + count;
+        uint32_t first_page = row / OTP_PAGE_ROWS;
+        uint32_t last_page = (end - 1) / OTP_PAGE_ROWS;
+        if (count == 1 || (first_page == last_page && first_page < OTP_PAGE_COUNT - OTP_SPECIAL_PAGES)) {
+            for (uint32_t r = row; r < end; r++) {
+                not_permitted.insert(r);
+                failed.insert(r);
+            }
+            return;
+        }
+        uint32_t mid = row + count / 2;
+        if (first_page != last_page) {
+            // split on the page boundary nearest the middle
+            mid = (mid + OTP_PAGE_ROWS / 2) / OTP_PAGE_ROWS * OTP_PAGE_ROWS;
+            if (mid <= row || mid >= end) mid = (first_page + 1) * OTP_PAGE_ROWS;
+        }
+        read_range(row, mid - row, ecc, buffer, failed);
+        read_range(mid, end - mid, ecc, buffer + (mid - row) * (ecc ? 2 : 4), failed);
+    }
+
+    otp_access &otp;
+    std::set<uint32_t> not_permitted;
+};
+
+
+// Collects OTP writes so they can all be checked against the current OTP contents before anything is written,
+// and then issued with as few PICOBOOT commands as possible. Writes go out as maximal runs of consecutive
+// changed rows with the same ECC mode within a page, followed by a single read back of every written row.
+struct otp_write_plan {
+    explicit otp_write_plan(otp_access &otp) : otp(otp), reader(otp) {}
+
+    // Reads rows as an otp_read of otp_cmd would, but returns planned values for rows already added to the plan
+    void read(uint8_t *buffer, uint32_t len, const picoboot_otp_cmd &otp_cmd) {
+        uint32_t row_size = otp_cmd.bEcc ? 2 : 4;
+        for (uint32_t i = 0; i < otp_cmd.wRowCount && (i + 1) * row_size <= len; i++) {
+            uint32_t row = otp_cmd.wRow + i;
+            auto p = rows.find(row);
+            uint32_t value;
+            if (p != rows.end()) {
+                value = p->second.ecc && !otp_cmd.bEcc ? otp_calculate_ecc(p->second.value) : p->second.value;
+            } else {
+                if (!fetch(row)) throw picoboot::command_failure(PICOBOOT_NOT_PERMITTED);
+                value = current[row];
+            }
+            memcpy(buffer + i * row_size, &value, row_size);
+        }
+    }
+
+    // Adds the rows an otp_write of otp_cmd would write
+    void add(const uint8_t *buffer, uint32_t len, const picoboot_otp_cmd &otp_cmd) {
+        uint32_t row_size = otp_cmd.bEcc ? 2 : 4;
+        if (len != otp_cmd.wRowCount * row_size || otp_cmd.wRow + otp_cmd.wRowCount > OTP_ROW_COUNT) {
+            fail(ERROR_FORMAT, "Invalid OTP write of %d bytes to %d rows at row 0x%x", len, otp_cmd.wRowCount, otp_cmd.wRow);
+        }
+        for (uint32_t i = 0; i < otp_cmd.wRowCount; i++) {
+            planned_row p;
+            p.ecc = otp_cmd.bEcc;
+            p.value = 0;
+            memcpy(&p.value, buffer + i * row_size, row_size);
+            auto existing = rows.find(otp_cmd.wRow + i);
+            if (existing != rows.end() && existing->second.ecc != p.ecc) {
+                fail(ERROR_INCOMPATIBLE, "OTP row 0x%x is written both with and without ECC", otp_cmd.wRow + i);
+            }
+            rows[otp_cmd.wRow + i] = p;
+        }
+    }
+
+    // Current raw value of row, which is read along with the rest of its page; returns false if it is not readable
+    bool fetch(uint32_t row, uint32_t &value) {
+        if (!fetch(row)) return false;
+        value = current[row];
+        return true;
+    }
+
+    void execute() {
+        // read the current contents of every page being written
+        std::set<uint32_t> pages;
+        for (const auto &e : rows) {
+            if (!current.count(e.first) && !unreadable.count(e.first)) pages.insert(e.first / OTP_PAGE_ROWS);
+        }
+        fetch_pages(pages);
+
+        // check every row before writing any
+        std::vector<uint32_t> changed;
+        for (const auto &e : rows) {
+            uint32_t row = e.first;
+            const auto &p = e.second;
+            if (unreadable.count(row)) {
+                // can't check, so leave it to the device
+                changed.push_back(row);
+                continue;
+            }
+            uint32_t old_raw = current[row];
+            uint32_t new_raw = p.ecc ? otp_calculate_ecc(p.value) : p.value & 0xffffff;
+            if (old_raw == new_raw) continue;
+            if (p.ecc && old_raw) {
+                fail(ERROR_NOT_POSSIBLE, "Cannot modify OTP ECC row 0x%x: current value %06x, new value %06x\n", row, old_raw, new_raw);
+            }
+            if (old_raw & ~new_raw) {
+                fail(ERROR_NOT_POSSIBLE, "Cannot clear bits in OTP row 0x%x: current value %06x, new value %06x\n", row, old_raw, new_raw);
+            }
+            changed.push_back(row);
+        }
+
+        for (size_t i = 0; i < changed.size();) {
+            size_t j = i + 1;
+            while (j < changed.size() && changed[j] == changed[j - 1] + 1 && rows[changed[j]].ecc == rows[changed[i]].ecc &&
+                   changed[j] / OTP_PAGE_ROWS == changed[i] / OTP_PAGE_ROWS) {
+                j++;
+            }
+            write_run(changed[i], (uint32_t)(j - i));
+            i = j;
+        }
+        DEBUG_LOG("Wrote %d OTP rows in %d commands\n", (int)changed.size(), writes);
+
+        // read back everything that was written, in as few ranges as possible
+        if (changed.empty()) return;
+        std::vector<uint32_t> readback(changed.back() - changed.front() + 1);
+        auto failed = reader.read(changed.front(), (uint32_t)readback.size(), false, (uint8_t *)readback.data());
+        for (auto row : changed) {
+            if (failed.count(row)) continue;
+            const auto &p = rows[row];
+            uint32_t expected = p.ecc ? otp_calculate_ecc(p.value) : p.value & 0xffffff;
+            uint32_t actual = readback[row - changed.front()] & 0xffffff;
+            if (actual != expected) {
+                fail(ERROR_VERIFICATION_FAILED, "OTP row 0x%x verification failed: expected %06x, read %06x\n", row, expected, actual);
+            }
+        }
+    }
+
+private:
+    struct planned_row {
+        bool ecc;
+        uint32_t value; // 16-bit value for ECC rows, otherwise the raw 24-bit value
+    };
+
+    bool fetch(uint32_t row) {
+        if (!current.count(row) && !unreadable.count(row)) fetch_pages({row / OTP_PAGE_ROWS});
+        return current.count(row);
+    }
+
+    void fetch_pages(const std::set<uint32_t> &pages) {
+        for (auto it = pages.begin(); it != pages.end();) {
+            uint32_t first = *it, last = *it;
+            while (++it != pages.end() && *it == last + 1) last = *it;
+            uint32_t row = first * OTP_PAGE_ROWS;
+            std::vector<uint32_t> values((last - first + 1) * OTP_PAGE_ROWS);
+            auto failed = reader.read(row, (uint32_t)values.size(), false, (uint8_t *)values.data());
+            for (uint32_t i = 0; i < values.size(); i++) {
+                if (failed.count(row + i)) unreadable.insert(row + i);
+                else current[row + i] = values[i];
+            }
+        }
+    }
+
+    void write_run(uint32_t row, uint32_t count) {
+        struct picoboot_otp_cmd otp_cmd;
+        otp_cmd.wRow = row;
+        otp_cmd.wRowCount = count;
+        otp_cmd.bEcc = rows[row].ecc;
+        uint32_t row_size = otp_cmd.bEcc ? 2 : 4;
+        vector<uint8_t> data(count * row_size);
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(data.data() + i * row_size, &rows[row + i].value, row_size);
+        }
+        try {
+            writes++;
+            otp.write(&otp_cmd, data.data(), data.size());
+        } catch (picoboot::command_failure &e) {
+            check_otp_write_error(e, otp_cmd.bEcc);
+            throw;
+        }
+    }
+
+    otp_access &otp;
+    otp_reader reader;
+    std::map<uint32_t, planned_row> rows;
+    std::map<uint32_t, uint32_t> current;
+    std::set<uint32_t> unreadable;
+    int writes = 0;
+};
+
+
 bool otp_get_command::execute(device_map &devices) {
-    auto con = get_single_rp2350_bootsel_device_connection(devices);
+    auto otp = get_otp_access(devices, true);
     hack_init_otp_regs();
     auto matches = filter_otp(settings.otp.selectors, settings.otp.ecc ? 16 : 24, settings.otp.fuzzy);
     uint32_t last_reg_row = 1; // invalid
     bool first = true;
     char buf[512];
-    uint32_t raw_buffer[OTP_PAGE_ROWS];
-    memset(raw_buffer, 0xaa, sizeof(raw_buffer));
     int indent0 = settings.otp.list_pages ? 18 : 8;
-    uint32_t last_page = -1;
-    picoboot_memory_access raw_access(con);
+
+    // Read all the rows needed up front; whole pages for normal pages, but only the selected rows (and their
+    // redundant copies) in the special pages, as other lock rows may not be readable
+    std::vector<uint32_t> raw_buffer(OTP_ROW_COUNT, 0xaaaaaaaa);
+    std::vector<bool> wanted(OTP_ROW_COUNT);
+    for (const auto& e : matches) {
+        const auto &m = e.second;
+        uint32_t from = m.reg_row, to = m.reg_row + 1;
+        if (m.reg_row / OTP_PAGE_ROWS < OTP_PAGE_COUNT - OTP_SPECIAL_PAGES) {
+            from = m.reg_row / OTP_PAGE_ROWS * OTP_PAGE_ROWS;
+            to = from + OTP_PAGE_ROWS;
+        } else {
+            int redundancy = settings.otp.redundancy;
+            if (redundancy < 0 && m.reg) redundancy = m.reg->redundancy;
+            to = std::min(m.reg_row + std::max(redundancy, 1), (uint32_t)OTP_ROW_COUNT);
+        }
+        std::fill(wanted.begin() + from, wanted.begin() + to, true);
+    }
+    otp_reader reader(*otp);
+    std::set<uint32_t> unreadable;
+    for (uint32_t row = 0; row < OTP_ROW_COUNT;) {
+        if (!wanted[row]) {
+            row++;
+            continue;
+        }
+        uint32_t end = row;
+        while (end < OTP_ROW_COUNT && wanted[end]) end++;
+        auto failed = reader.read(row, end - row, false, (uint8_t *)&raw_buffer[row]);
+        unreadable.insert(failed.begin(), failed.end());
+        row = end;
+    }
+    auto raw_row = [&](uint32_t row) { return row < OTP_ROW_COUNT ? raw_buffer[row] : 0xaaaaaaaa; };
+
     for (const auto& e : matches) {
         const auto &m = e.second;
         bool do_ecc = settings.otp.ecc;
         int redundancy = settings.otp.redundancy;
         uint32_t corrected_val = 0;
-        if (m.reg_row / OTP_PAGE_ROWS != last_page) {
-            // todo pre-check page lock
-            struct picoboot_otp_cmd otp_cmd;
-            if (m.reg_row / OTP_PAGE_ROWS >= OTP_PAGE_COUNT - OTP_SPECIAL_PAGES) {
-                // Read individual rows for lock words
-                otp_cmd.wRow = m.reg_row;
-                otp_cmd.wRowCount = 1;
-                otp_cmd.bEcc = 0;
-                con.otp_read(&otp_cmd, (uint8_t *)&(raw_buffer[m.reg_row % OTP_PAGE_ROWS]), sizeof(raw_buffer[0]));
-            } else {
-                // Otherwise read a page at a time
-                last_page = m.reg_row / OTP_PAGE_ROWS;
-                otp_cmd.wRow = last_page * OTP_PAGE_ROWS;
-                otp_cmd.wRowCount = OTP_PAGE_ROWS;
-                otp_cmd.bEcc = 0;
-                con.otp_read(&otp_cmd, (uint8_t *)raw_buffer, sizeof(raw_buffer));
-            }
+        if (unreadable.count(m.reg_row)) {
+            throw picoboot::command_failure(PICOBOOT_NOT_PERMITTED);
         }
         if (m.reg_row != last_reg_row) {
             last_reg_row = m.reg_row;
@@ -7633,12 +10585,12 @@ bool otp_get_command::execute(device_map &devices) {
             }
             fos.first_column(4);
             fos.hanging_indent(10);
-            uint32_t raw_value = raw_buffer[m.reg_row % OTP_PAGE_ROWS];
+            uint32_t raw_value = raw_row(m.reg_row);
             char raw_buf[16 * 1024];
             uint8_t buf_pos = 0;
             buf_pos += snprintf(raw_buf+buf_pos, sizeof(raw_buf), "RAW_VALUE=0x%06x", raw_value);
             for (int i=1; i < std::max(redundancy, 1); i++) {
-                raw_value = raw_buffer[(m.reg_row % OTP_PAGE_ROWS) + i];
+                raw_value = raw_row(m.reg_row + i);
                 buf_pos += snprintf(raw_buf+buf_pos, sizeof(raw_buf) - buf_pos, ";0x%06x", raw_value);
                 if (3 == (raw_value >> 22)) {
                     raw_value ^= 0xffffff;
@@ -7662,7 +10614,7 @@ bool otp_get_command::execute(device_map &devices) {
                 bool diff = false;
                 bool crit = m.reg ? m.reg->crit : false;
                 for (int i=0; i < redundancy; i++) {
-                    raw_value = raw_buffer[(m.reg_row % OTP_PAGE_ROWS) + i];
+                    raw_value = raw_row(m.reg_row + i);
                     for (int b=0; b < 24; b++) raw_value & (1 << b) ? sets[b]++ : clears[b]++;
                 }
                 for (int b=0; b < 24; b++){
@@ -7715,7 +10667,7 @@ bool otp_get_command::execute(device_map &devices) {
             otp_cmd.bEcc = 1;
             otp_cmd.wRowCount = 1;
             uint16_t val = 0xaaaa;
-            con.otp_read(&otp_cmd, (uint8_t *)&val, sizeof(val));
+            otp->read(&otp_cmd, (uint8_t *)&val, sizeof(val));
             snprintf(buf, sizeof(buf), "EXTRA ECC READ: %04x\n", val);
             fos << buf;
         }
@@ -7730,8 +10682,7 @@ bool otp_dump_command::execute(device_map &devices) {
     vector<uint8_t> raw_buffer;
     uint8_t row_size = do_ecc ? 2 : 4;
     raw_buffer.resize(OTP_ROW_COUNT * row_size);
-    std::map<int, string> page_errors;
-    std::map<int, string> row_errors;
+    std::set<uint32_t> unreadable;
 
     if (!settings.filenames[0].empty()) {
         std::shared_ptr<std::fstream> file = get_file(ios::in|ios::binary);
@@ -7767,38 +10718,10 @@ bool otp_dump_command::execute(device_map &devices) {
         );
         fos_ptr = fos_base_ptr;
     } else {
-        auto con = get_single_rp2350_bootsel_device_connection(devices, false);
-        struct picoboot_otp_cmd otp_cmd;
-        otp_cmd.bEcc = do_ecc;
-        // Read most pages by page, as permissions are per page
-        otp_cmd.wRowCount = OTP_PAGE_ROWS;
-        for (int i=0; i < OTP_PAGE_COUNT - OTP_SPECIAL_PAGES; i++) {
-            otp_cmd.wRow = i * OTP_PAGE_ROWS;
-            try {
-                con.otp_read(&otp_cmd, raw_buffer.data() + i*(raw_buffer.size() / OTP_PAGE_COUNT), raw_buffer.size() / OTP_PAGE_COUNT);
-            } catch (picoboot::command_failure& e) {
-                if (e.get_code() == PICOBOOT_NOT_PERMITTED) {
-                    page_errors[i] = e.what();
-                } else {
-                    throw e;
-                }
-            }
-        }
-
-        // Read special pages by row, as permissions are special
-        otp_cmd.wRowCount = 1;
-        for (int i=(OTP_PAGE_COUNT - OTP_SPECIAL_PAGES) * OTP_PAGE_ROWS; i < OTP_PAGE_COUNT * OTP_PAGE_ROWS; i++) {
-            otp_cmd.wRow = i;
-            try {
-                con.otp_read(&otp_cmd, raw_buffer.data() + i * row_size, row_size);
-            } catch (picoboot::command_failure& e) {
-                if (e.get_code() == PICOBOOT_NOT_PERMITTED) {
-                    row_errors[i] = e.what();
-                } else {
-                    throw e;
-                }
-            }
-        }
+        auto otp = get_otp_access(devices, false);
+        otp_reader reader(*otp);
+        unreadable = reader.read(0, OTP_ROW_COUNT, do_ecc, raw_buffer.data());
+        DEBUG_LOG("Read OTP with %u commands\n", reader.commands);
     }
 
     fos.first_column(0);
@@ -7820,7 +10743,7 @@ bool otp_dump_command::execute(device_map &devices) {
             }
 
             for (int j = i; j < i + 8; j++) {
-                if (row_errors.find(j) != row_errors.end() || page_errors.find(j / OTP_PAGE_ROWS) != page_errors.end()) {
+                if (unreadable.count(j)) {
                     snprintf(buf, sizeof(buf), "%s, ", do_ecc ? "XXXX" : "XXXXXXXX");
                 } else if (do_ecc) {
                     snprintf(buf, sizeof(buf), "%04x, ", ((uint16_t *) raw_buffer.data())[j]);
@@ -7836,7 +10759,7 @@ bool otp_dump_command::execute(device_map &devices) {
 }
 
 bool otp_load_command::execute(device_map &devices) {
-    auto con = get_single_rp2350_bootsel_device_connection(devices, false);
+    auto otp = get_otp_access(devices, false, true);
     // todo pre-check page lock
     struct picoboot_otp_cmd otp_cmd;
     std::shared_ptr<std::fstream> file = get_file(ios::in|ios::binary);
@@ -7844,18 +10767,15 @@ bool otp_load_command::execute(device_map &devices) {
         hack_init_otp_regs();
         json otp_json = json::parse(*file);
         // todo validation on json
+        otp_write_plan plan(*otp);
         process_otp_json(otp_json,
             [&](uint8_t *buffer, uint32_t len, picoboot_otp_cmd &otp_cmd) {
-                picoboot_memory_access raw_access(con);
-                con.otp_read(&otp_cmd, buffer, len);
+                plan.read(buffer, len, otp_cmd);
             }, [&](uint8_t *buffer, uint32_t len, picoboot_otp_cmd &otp_cmd) {
-                try {
-                    con.otp_write(&otp_cmd, buffer, len);
-                } catch (picoboot::command_failure &e) {
-                    check_otp_write_error(e, otp_cmd.bEcc);
-                    throw e;
-                }
+                plan.add(buffer, len, otp_cmd);
         });
+        plan.execute();
+        otp->flush();
 
         // Return now, don't do rest of function
         return false;
@@ -7879,16 +10799,16 @@ bool otp_load_command::execute(device_map &devices) {
     uint8_t* file_buffer = unique_file_buffer.get();
     file->read((char*)file_buffer, file_size);
     try {
-        con.otp_write(&otp_cmd, (uint8_t *)file_buffer, file_size);
+        otp->write(&otp_cmd, (uint8_t *)file_buffer, file_size);
     } catch (picoboot::command_failure &e) {
         check_otp_write_error(e, otp_cmd.bEcc);
         throw e;
     }
+    otp->flush();
 
     std::unique_ptr<uint8_t[]> unique_verify_buffer(new uint8_t[file_size]());
     uint8_t* verify_buffer = unique_verify_buffer.get();
-    picoboot_memory_access raw_access(con);
-    con.otp_read(&otp_cmd, (uint8_t *)verify_buffer, file_size);
+    otp->read(&otp_cmd, (uint8_t *)verify_buffer, file_size);
     unsigned int i;
     for(i=0;i<file_size;i++) {
         if (file_buffer[i] != verify_buffer[i]) {
@@ -7987,7 +10907,7 @@ bool otp_list_command::execute(device_map &devices) {
 
 #if HAS_LIBUSB
 bool otp_set_command::execute(device_map &devices) {
-    auto con = get_single_rp2350_bootsel_device_connection(devices, false);
+    auto otp = get_otp_access(devices, false, true);
     hack_init_otp_regs();
     auto matches = filter_otp(settings.otp.selectors, settings.otp.ecc ? 16 : 24, settings.otp.fuzzy);
     // baing lazy to count
@@ -8016,8 +10936,10 @@ bool otp_set_command::execute(device_map &devices) {
     otp_cmd.wRowCount = 1;
     otp_cmd.bEcc = 0;
     uint32_t old_raw_value;
-    picoboot_memory_access raw_access(con);
-    con.otp_read(&otp_cmd, (uint8_t *)&old_raw_value, sizeof(old_raw_value));
+    otp_write_plan plan(*otp);
+    if (!plan.fetch(reg_row, old_raw_value)) {
+        throw picoboot::command_failure(PICOBOOT_NOT_PERMITTED);
+    }
     fos.first_column(0);
     fos.hanging_indent(7);
     snprintf(buf, sizeof(buf), "ROW 0x%04x", reg_row);
@@ -8109,25 +11031,21 @@ bool otp_set_command::execute(device_map &devices) {
     if (~settings.otp.value & old_raw_value) {
         fail(ERROR_NOT_POSSIBLE, "Cannot clear bits in OTP row(s): current value %06x, new value %06x\n", old_raw_value, settings.otp.value);
     }
-    // todo this is currently crappy, incorrect and generally evil
     otp_cmd.bEcc = settings.otp.ecc;
-    try {
-        if (otp_cmd.bEcc) {
-            uint16_t write_value = settings.otp.value;
-            con.otp_write(&otp_cmd, (uint8_t *) &write_value, sizeof(write_value));
-        } else if (settings.otp.redundancy > 0) {
-            otp_cmd.wRowCount = settings.otp.redundancy;
-            vector<uint32_t> write_value;
-            for (int i=0; i < otp_cmd.wRowCount; i++) write_value.push_back(settings.otp.value);
-            con.otp_write(&otp_cmd, (uint8_t *)write_value.data(), write_value.size() * sizeof(uint32_t));
-        } else {
-            uint32_t write_value = settings.otp.value;
-            con.otp_write(&otp_cmd, (uint8_t *)&write_value, sizeof(write_value));
-        }
-    } catch (picoboot::command_failure &e) {
-        check_otp_write_error(e, otp_cmd.bEcc);
-        throw e;
+    if (otp_cmd.bEcc) {
+        uint16_t write_value = settings.otp.value;
+        plan.add((uint8_t *) &write_value, sizeof(write_value), otp_cmd);
+    } else if (settings.otp.redundancy > 0) {
+        otp_cmd.wRowCount = settings.otp.redundancy;
+        vector<uint32_t> write_value;
+        for (int i=0; i < otp_cmd.wRowCount; i++) write_value.push_back(settings.otp.value);
+        plan.add((uint8_t *)write_value.data(), write_value.size() * sizeof(uint32_t), otp_cmd);
+    } else {
+        uint32_t write_value = settings.otp.value;
+        plan.add((uint8_t *)&write_value, sizeof(write_value), otp_cmd);
     }
+    plan.execute();
+    otp->flush();
 
     return false;
 }
@@ -8277,7 +11195,7 @@ void wl_do_field(json json_data, vector<uint16_t>& data, uint32_t& flags, const
 }
 
 bool otp_white_label_command::execute(device_map &devices) {
-    auto con = get_single_rp2350_bootsel_device_connection(devices, false);
+    auto otp = get_otp_access(devices, false, true);
     hack_init_otp_regs();
     const otp_reg* flags_reg;
     const otp_reg* addr_reg;
@@ -8359,28 +11277,20 @@ bool otp_white_label_command::execute(device_map &devices) {
     }
     fos << "\n";
 
+    // Check all three writes against the current contents before making any of them
+    otp_write_plan plan(*otp);
+
     // Write struct
     otp_cmd.bEcc = true;
     otp_cmd.wRow = struct_row;
     otp_cmd.wRowCount = data.size();
-
-    try {
-        con.otp_write(&otp_cmd, (uint8_t*)data.data(), data.size()*sizeof(data[0]));
-    } catch (picoboot::command_failure &e) {
-        check_otp_write_error(e, otp_cmd.bEcc);
-        throw e;
-    }
+    plan.add((uint8_t*)data.data(), data.size()*sizeof(data[0]), otp_cmd);
 
     // Write addr
     otp_cmd.bEcc = true;
     otp_cmd.wRow = addr_reg->row;
     otp_cmd.wRowCount = 1;
-    try {
-        con.otp_write(&otp_cmd, (uint8_t*)&struct_row, sizeof(struct_row));
-    } catch (picoboot::command_failure &e) {
-        check_otp_write_error(e, otp_cmd.bEcc);
-        throw e;
-    }
+    plan.add((uint8_t*)&struct_row, sizeof(struct_row), otp_cmd);
 
     // Write flags
     otp_cmd.bEcc = false;
@@ -8391,12 +11301,10 @@ bool otp_white_label_command::execute(device_map &devices) {
 
     tmp_data.resize(otp_cmd.wRowCount);
     for (int i=1; i < otp_cmd.wRowCount; i++) std::copy_n(tmp_data.begin(), 1, tmp_data.begin() + i);
-    try {
-        con.otp_write(&otp_cmd, (uint8_t*)tmp_data.data(), tmp_data.size()*sizeof(flags));
-    } catch (picoboot::command_failure &e) {
-        check_otp_write_error(e, otp_cmd.bEcc);
-        throw e;
-    }
+    plan.add((uint8_t*)tmp_data.data(), tmp_data.size()*sizeof(flags), otp_cmd);
+
+    plan.execute();
+    otp->flush();
 
     return false;
 }
@@ -8813,6 +11721,11 @@ int main(int argc, char **argv) {
         rc = ERROR_UNKNOWN;
     }
 
+    auto &cache_stats = picoboot::connection::get_cache_stats();
+    if (cache_stats.hits) {
+        fos_verbose << cache_stats.hits << " of " << cache_stats.hits + cache_stats.misses << " device metadata requests were answered from cache\n";
+    }
+
     for(const auto &handle : to_close) {
         libusb_close(handle);
     }
@@ -20,4 +20,14 @@ std::basic_string<T> uppercase(const std::basic_string<T>& s)
     return s2;
 }
 
-void init_otp(std::map<uint32_t, otp_reg> &otp_regs, std::vector<std::string> extra_otp_files) {}
+const otp_reg *otp_reg_map::find(uint32_t row) { return nullptr; }
+
+std::vector<uint32_t> otp_reg_map::rows_named(const std::string &upper_name) const { return {}; }
+
+std::vector<uint32_t> otp_reg_map::rows_containing(const std::string &upper_sub) const { return {}; }
+
+void otp_reg_map::for_each(uint32_t begin_row, uint32_t end_row, const std::function<void(const otp_reg &reg)> &f) {}
+
+void otp_reg_map::add(const otp_reg &r) {}
+
+void init_otp(otp_reg_map &otp_regs, std::vector<std::string> extra_otp_files) {}
@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <cstring>
 #include <map>
 #include <fstream>
 
@@ -11,6 +12,7 @@
 #include "otp_contents.h"
 #else
 #include "data_locs.h"
+#include "rp2350_otp_table.h"
 #endif
 
 #ifndef NDEBUG
@@ -19,8 +21,6 @@
 #define DEBUG_LOG(...) ((void)0)
 #endif
 
-#include "rp2350.json.h"
-
 template <typename T>
 std::basic_string<T> lowercase(const std::basic_string<T>& s)
 {
@@ -37,9 +37,149 @@ std::basic_string<T> uppercase(const std::basic_string<T>& s)
     return s2;
 }
 
-void init_otp(std::map<uint32_t, otp_reg> &otp_regs, std::vector<std::string> extra_otp_files) {
+#if !CODE_OTP
+static otp_reg otp_reg_from_table(const otp_table_reg &t) {
+    otp_reg r;
+    r.name = otp_table_strings + t.name;
+    r.upper_name = otp_table_strings + t.upper_name;
+    r.description = otp_table_strings + t.description;
+    r.row = t.row;
+    r.mask = t.mask;
+    r.ecc = t.flags & OTP_TABLE_ECC;
+    r.crit = t.flags & OTP_TABLE_CRIT;
+    r.redundancy = t.redundancy;
+    r.seq_index = t.seq_index;
+    r.seq_length = t.seq_length;
+    r.seq_prefix = otp_table_strings + t.seq_prefix;
+    r.fields.reserve(t.field_count);
+    for (uint32_t i = t.first_field; i < t.first_field + t.field_count; i++) {
+        const auto &tf = otp_table_fields[i];
+        otp_field f;
+        f.name = otp_table_strings + tf.name;
+        f.upper_name = otp_table_strings + tf.upper_name;
+        f.mask = tf.mask;
+        f.description = otp_table_strings + tf.description;
+        r.fields.push_back(std::move(f));
+    }
+    return r;
+}
+
+static const otp_table_reg *find_otp_table_reg(const std::string &upper_name) {
+    const uint32_t bucket_count = sizeof(otp_table_name_seeds) / sizeof(otp_table_name_seeds[0]);
+    const uint32_t slot_count = sizeof(otp_table_name_slots) / sizeof(otp_table_name_slots[0]);
+    uint32_t seed = otp_table_name_seeds[otp_table_hash(upper_name.data(), upper_name.size(), 0) % bucket_count];
+    uint32_t index = otp_table_name_slots[otp_table_hash(upper_name.data(), upper_name.size(), seed) % slot_count];
+    if (index == OTP_TABLE_NO_REG || upper_name != otp_table_strings + otp_table_regs[index].upper_name) return nullptr;
+    return &otp_table_regs[index];
+}
+
+static const otp_table_gram *find_otp_table_gram(const char *s, size_t len) {
+    uint32_t key = otp_table_gram_key(s, len);
+    auto g = std::lower_bound(std::begin(otp_table_grams), std::end(otp_table_grams), key,
+                              [](const otp_table_gram &g, uint32_t key) { return g.key < key; });
+    if (g == std::end(otp_table_grams) || g->key != key) return nullptr;
+    return g;
+}
+
+static const otp_table_reg *table_lower_bound(uint32_t row) {
+    return std::lower_bound(std::begin(otp_table_regs), std::end(otp_table_regs), row,
+                            [](const otp_table_reg &t, uint32_t row) { return t.row < row; });
+}
+#endif
+
+const otp_reg *otp_reg_map::find(uint32_t row) {
+    auto b = built.find(row);
+    if (b != built.end()) return &b->second;
+#if !CODE_OTP
+    auto t = table_lower_bound(row);
+    if (t != std::end(otp_table_regs) && t->row == row) {
+        return &built.emplace(row, otp_reg_from_table(*t)).first->second;
+    }
+#endif
+    return nullptr;
+}
+
+std::vector<uint32_t> otp_reg_map::rows_named(const std::string &upper_name) const {
+    std::vector<uint32_t> rows;
+    auto named = added_rows_by_name.find(upper_name);
+    if (named != added_rows_by_name.end()) {
+        for (auto row : named->second) {
+            // the row may since have been replaced by a differently named register from an extra file
+            if (built.at(row).upper_name == upper_name) rows.push_back(row);
+        }
+    }
+#if !CODE_OTP
+    auto t = find_otp_table_reg(upper_name);
+    if (t && !added_rows.count(t->row)) {
+        rows.insert(std::upper_bound(rows.begin(), rows.end(), t->row), t->row);
+    }
+#endif
+    return rows;
+}
+
+std::vector<uint32_t> otp_reg_map::rows_containing(const std::string &upper_sub) const {
+    std::vector<uint32_t> rows;
+    for (auto row : added_rows) {
+        if (built.at(row).upper_name.find(upper_sub) != std::string::npos) rows.push_back(row);
+    }
+#if !CODE_OTP
+    auto added_end = rows.size();
+    auto add_table_reg = [&](const otp_table_reg &t) {
+        // a built-in register replaced by an added one was checked with the added ones
+        if (!added_rows.count(t.row)) rows.push_back(t.row);
+    };
+    if (upper_sub.empty()) {
+        for (const auto &t : otp_table_regs) add_table_reg(t);
+    } else {
+        // a name containing upper_sub contains each of its grams, so the shortest posting list holds them all
+        size_t len = std::min(upper_sub.size(), (size_t)OTP_TABLE_MAX_GRAM);
+        const otp_table_gram *candidates = nullptr;
+        for (size_t pos = 0; pos + len <= upper_sub.size(); pos++) {
+            auto g = find_otp_table_gram(upper_sub.data() + pos, len);
+            if (!g) {
+                candidates = nullptr;
+                break;
+            }
+            if (!candidates || g->count < candidates->count) candidates = g;
+        }
+        for (uint32_t i = 0; candidates && i < candidates->count; i++) {
+            const auto &t = otp_table_regs[otp_table_gram_postings[candidates->first + i]];
+            if (len == upper_sub.size() || strstr(otp_table_strings + t.upper_name, upper_sub.c_str())) {
+                add_table_reg(t);
+            }
+        }
+    }
+    std::inplace_merge(rows.begin(), rows.begin() + added_end, rows.end());
+#endif
+    return rows;
+}
+
+void otp_reg_map::for_each(uint32_t begin_row, uint32_t end_row, const std::function<void(const otp_reg &reg)> &f) {
+    std::vector<uint32_t> rows(added_rows.lower_bound(begin_row), added_rows.lower_bound(end_row));
+#if !CODE_OTP
+    auto added_end = rows.size();
+    for (auto t = table_lower_bound(begin_row); t != std::end(otp_table_regs) && t->row < end_row; t++) {
+        rows.push_back(t->row);
+    }
+    std::inplace_merge(rows.begin(), rows.begin() + added_end, rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+#endif
+    for (auto row : rows) f(*find(row));
+}
+
+void otp_reg_map::add(const otp_reg &r) {
+    built[r.row] = r;
+    added_rows.insert(r.row);
+    added_rows_by_name[r.upper_name].insert(r.row);
+    adds++;
+}
+
+void init_otp(otp_reg_map &otp_regs, std::vector<std::string> extra_otp_files) {
 #if CODE_OTP
-    std::transform(otp_reg_list.begin(), otp_reg_list.end(), std::inserter(otp_regs, otp_regs.end()), [](const otp_reg& r) { return std::make_pair( r.row, r); });
+    // init_otp may be called more than once
+    if (!otp_regs.generation()) {
+        for (const auto &r : otp_reg_list) otp_regs.add(r);
+    }
 #elif 0
     // search same directory as executable
     whereami::whereami_path_t executablePath = whereami::getExecutablePath();
@@ -59,15 +199,12 @@ void init_otp(std::map<uint32_t, otp_reg> &otp_regs, std::vector<std::string> ex
             printf("Picking OTP JSON file %s\n", filename.c_str());
             json j;
             i >> j;
-            std::transform(j.begin(), j.end(), std::inserter(otp_regs, otp_regs.end()), [](const otp_reg& r) { return std::make_pair( r.row, r); });
+            for (const auto &e : j) otp_regs.add(e.get<otp_reg>());
             break;
         } else {
             DEBUG_LOG("Can't find JSON file %s\n", filename.c_str());
         }
     }
-#else
-    json j = json::parse(rp2350_json);
-    std::transform(j.begin(), j.end(), std::inserter(otp_regs, otp_regs.end()), [](const otp_reg& r) { return std::make_pair( r.row, r); });
 #endif
 
     for (auto filename : extra_otp_files) {
@@ -76,7 +213,9 @@ void init_otp(std::map<uint32_t, otp_reg> &otp_regs, std::vector<std::string> ex
             printf("Adding OTP JSON file %s\n", filename.c_str());
             json j;
             i >> j;
-            std::transform(j.begin(), j.end(), std::inserter(otp_regs, otp_regs.end()), [](const otp_reg& r) { return std::make_pair( r.row, r); });
+            for (const auto &e : j) {
+                otp_regs.add(e.get<otp_reg>());
+            }
         } else {
             printf("Can't find JSON file %s\n", filename.c_str());
         }
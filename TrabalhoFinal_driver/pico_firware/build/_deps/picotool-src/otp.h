@@ -11,6 +11,9 @@
 #include <cassert>
 #include <vector>
 #include <cstdint>
+#include <map>
+#include <set>
+#include <functional>
 
 #include "nlohmann/json.hpp"
 
@@ -92,6 +95,30 @@ struct otp_reg {
     }
 };
 
-void init_otp(std::map<uint32_t, otp_reg> &otp_regs, std::vector<std::string> extra_otp_files = {});
+// OTP registers by row. The compiled-in registers stay in their read-only table, and each one is only turned
+// into an otp_reg the first time it is looked up; registers given to add replace any built-in one at the same row
+struct otp_reg_map {
+    // Returns nullptr if there is no register at row
+    const otp_reg *find(uint32_t row);
+    // Rows of the registers with exactly this upper-case name, in order. Built-in names are looked up in the
+    // table's perfect hash and added ones in a map, so nothing is scanned
+    std::vector<uint32_t> rows_named(const std::string &upper_name) const;
+    // Rows of the registers whose upper-case name contains upper_sub, in order. Built-in names are narrowed down
+    // with the table's n-gram postings, and only the added ones are checked directly
+    std::vector<uint32_t> rows_containing(const std::string &upper_sub) const;
+    // Calls f for each register with a row in [begin_row, end_row), in row order
+    void for_each(uint32_t begin_row, uint32_t end_row, const std::function<void(const otp_reg &reg)> &f);
+    void add(const otp_reg &r);
+    // Changes each time a register is added
+    unsigned int generation() const { return adds; }
+private:
+    std::map<uint32_t, otp_reg> built;  // the added registers, and the built-in ones looked up so far
+    std::map<std::string, std::set<uint32_t>> added_rows_by_name;
+    std::set<uint32_t> added_rows;
+    unsigned int adds = 0;
+};
+
+// Adds the registers in extra_otp_files to otp_regs; the compiled-in register database needs no setup
+void init_otp(otp_reg_map &otp_regs, std::vector<std::string> extra_otp_files = {});
 
 #endif
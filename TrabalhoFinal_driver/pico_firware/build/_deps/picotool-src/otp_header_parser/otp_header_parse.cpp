@@ -8,11 +8,16 @@
 #include <iostream>
 #include <fstream>
 #include <regex>
+#include <sstream>
 #include <map>
 #include <cassert>
 #include <cstdint>
+#include <algorithm>
+#include <iomanip>
+#include <type_traits>
 
 #include "nlohmann/json.hpp"
+#include "otp_table.h"
 
 // missing __builtins on windows
 #if defined(_MSC_VER) && !defined(__clang__)
@@ -33,7 +38,7 @@ using json = nlohmann::json;
 // todo values?
 
 static void usage() {
-    std::cerr << "usage: otp_header_parser <otp_data.h filename> <output header filename>" << std::endl;
+    std::cerr << "usage: otp_header_parser <otp_data.h filename> <output header filename> [<output table header filename>]" << std::endl;
 }
 
 enum {
@@ -122,6 +127,150 @@ bool valid_description(std::string description) {
     return true;
 }
 
+// Interns strings into a single NUL-separated pool; offset 0 is the empty string
+struct string_pool {
+    string_pool() { add(""); }
+    uint32_t add(const std::string &s) {
+        auto it = offsets.find(s);
+        if (it != offsets.end()) return it->second;
+        auto offset = (uint32_t)data.size();
+        data.insert(data.end(), s.begin(), s.end());
+        data.push_back(0);
+        offsets.emplace(s, offset);
+        return offset;
+    }
+    std::vector<char> data;
+    std::map<std::string, uint32_t> offsets;
+};
+
+std::string upper(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+// Builds the hash-and-displace name index described in otp_table.h; slots[] holds indexes into names
+bool build_name_index(const std::vector<std::string> &names, std::vector<uint16_t> &seeds, std::vector<uint16_t> &slots) {
+    uint32_t bucket_count = std::max<uint32_t>(1, (uint32_t)(names.size() + 3) / 4);
+    uint32_t slot_count = std::max<uint32_t>(1, (uint32_t)(names.size() + names.size() / 4));
+    std::vector<std::vector<uint16_t>> buckets(bucket_count);
+    for (uint16_t i = 0; i < names.size(); i++) {
+        buckets[otp_table_hash(names[i].data(), names[i].size(), 0) % bucket_count].push_back(i);
+    }
+    std::vector<uint32_t> order(bucket_count);
+    for (uint32_t b = 0; b < bucket_count; b++) order[b] = b;
+    // place the largest buckets first, while most slots are still free
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return buckets[a].size() > buckets[b].size(); });
+    seeds.assign(bucket_count, 0);
+    slots.assign(slot_count, OTP_TABLE_NO_REG);
+    for (auto b : order) {
+        if (buckets[b].empty()) break;
+        bool placed = false;
+        for (uint32_t seed = 1; seed <= 0xffff && !placed; seed++) {
+            std::vector<uint32_t> taken;
+            for (auto i : buckets[b]) {
+                uint32_t slot = otp_table_hash(names[i].data(), names[i].size(), seed) % slot_count;
+                if (slots[slot] != OTP_TABLE_NO_REG || std::find(taken.begin(), taken.end(), slot) != taken.end()) break;
+                taken.push_back(slot);
+            }
+            if (taken.size() == buckets[b].size()) {
+                for (size_t k = 0; k < taken.size(); k++) slots[taken[k]] = buckets[b][k];
+                seeds[b] = (uint16_t)seed;
+                placed = true;
+            }
+        }
+        if (!placed) return false;
+    }
+    return true;
+}
+
+template <typename T> void write_array(std::ostream &out, const char *decl, const std::vector<T> &values) {
+    out << decl << " = {";
+    for (size_t i = 0; i < values.size(); i++) {
+        out << (i % 12 ? " " : "\n    ") << "0x" << std::hex << std::setw(sizeof(T) * 2) << std::setfill('0') << (uint32_t)(typename std::make_unsigned<T>::type)values[i] << ",";
+    }
+    out << std::dec << std::setfill(' ') << "\n};\n\n";
+}
+
+// Writes the registers as read-only tables (see otp_table.h), ordered by row
+int write_table(const std::map<std::string, otp_reg> &regs, std::ostream &out) {
+    std::vector<const otp_reg *> sorted;
+    for (const auto &e : regs) sorted.push_back(&e.second);
+    std::stable_sort(sorted.begin(), sorted.end(), [](const otp_reg *a, const otp_reg *b) { return a->row < b->row; });
+    if (sorted.size() >= OTP_TABLE_NO_REG) {
+        cerr << "ERROR: too many registers for the OTP table" << std::endl;
+        return ERROR_INPUT;
+    }
+
+    string_pool strings;
+    std::vector<std::string> names;
+    std::ostringstream reg_lines, field_lines;
+    uint32_t field_count = 0;
+    for (const auto *r : sorted) {
+        if (r->fields.size() > 0xff || field_count + r->fields.size() > 0xffff || r->redundancy < 0 || r->redundancy > 0xff ||
+            r->seq_index < 0 || r->seq_index > 0xff || r->seq_length < 0 || r->seq_length > 0xff) {
+            cerr << "ERROR: " << r->name << " does not fit in the OTP table" << std::endl;
+            return ERROR_INPUT;
+        }
+        auto upper_name = upper(r->name);
+        if (std::find(names.begin(), names.end(), upper_name) != names.end()) {
+            cerr << "ERROR: duplicate register name " << upper_name << std::endl;
+            return ERROR_INPUT;
+        }
+        names.push_back(upper_name);
+        reg_lines << "    {0x" << std::hex << r->row << ", 0x" << r->mask << std::dec
+                  << ", " << strings.add(r->name) << ", " << strings.add(upper_name) << ", " << strings.add(r->description)
+                  << ", " << strings.add(r->seq_prefix) << ", " << field_count << ", " << r->fields.size()
+                  << ", " << ((r->ecc ? OTP_TABLE_ECC : 0) | (r->crit ? OTP_TABLE_CRIT : 0))
+                  << ", " << r->redundancy << ", " << r->seq_index << ", " << r->seq_length << "}, // " << r->name << "\n";
+        for (const auto &f : r->fields) {
+            field_lines << "    {0x" << std::hex << f.mask << std::dec << ", " << strings.add(f.name) << ", " << strings.add(upper(f.name))
+                        << ", " << strings.add(f.description) << "}, // " << r->name << "." << f.name << "\n";
+        }
+        field_count += r->fields.size();
+    }
+
+    std::vector<uint16_t> seeds, slots;
+    if (!build_name_index(names, seeds, slots)) {
+        cerr << "ERROR: could not build OTP register name index" << std::endl;
+        return ERROR_UNKNOWN;
+    }
+
+    // the registers containing each gram of the names, for substring selectors
+    std::map<uint32_t, std::vector<uint16_t>> grams;
+    for (uint16_t i = 0; i < names.size(); i++) {
+        for (size_t len = 1; len <= OTP_TABLE_MAX_GRAM; len++) {
+            for (size_t pos = 0; pos + len <= names[i].size(); pos++) {
+                auto &postings = grams[otp_table_gram_key(names[i].data() + pos, len)];
+                if (postings.empty() || postings.back() != i) postings.push_back(i);
+            }
+        }
+    }
+    std::ostringstream gram_lines;
+    std::vector<uint16_t> postings;
+    for (const auto &g : grams) {
+        gram_lines << "    {0x" << std::hex << g.first << std::dec << ", " << postings.size() << ", " << g.second.size() << "},\n";
+        postings.insert(postings.end(), g.second.begin(), g.second.end());
+    }
+
+    out << "// GENERATED FILE; DO NOT EDIT //\n\n";
+    out << "#pragma once\n\n";
+    out << "#include \"otp_table.h\"\n\n";
+    // emitted as bytes rather than a string literal, which MSVC limits in length
+    write_array(out, "static const char otp_table_strings[]", strings.data);
+    out << "static const otp_table_reg otp_table_regs[] = {\n" << reg_lines.str() << "};\n\n";
+    out << "static const otp_table_field otp_table_fields[] = {\n";
+    if (!field_count) out << "    {0, 0, 0, 0},\n";
+    out << field_lines.str() << "};\n\n";
+    write_array(out, "static const uint16_t otp_table_name_seeds[]", seeds);
+    write_array(out, "static const uint16_t otp_table_name_slots[]", slots);
+    out << "static const otp_table_gram otp_table_grams[] = {\n";
+    if (grams.empty()) out << "    {0, 0, 0},\n";
+    out << gram_lines.str() << "};\n\n";
+    if (postings.empty()) postings.push_back(0);
+    write_array(out, "static const uint16_t otp_table_gram_postings[]", postings);
+    return out.good() ? 0 : ERROR_UNKNOWN;
+}
+
 int main(int argc, char **argv) {
     if (argc < 2) {
         usage();
@@ -380,6 +529,11 @@ int main(int argc, char **argv) {
             otp_regs_vec.push_back(e.second);
         j = otp_regs_vec;
         out_file << std::setw(4) << j << std::endl;
+        if (argc > 3) {
+            std::ofstream table_file(argv[3]);
+            int rc = write_table(otp_regs, table_file);
+            if (rc) return rc;
+        }
     #endif
     } catch (std::exception &e) {
         cerr << "ERROR: " << e.what() << "\n\n";
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _OTP_TABLE_H
+#define _OTP_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Layout of the compiled-in OTP register database written by otp_header_parse. All strings are offsets
+// into a single NUL-separated pool (otp_table_strings), with identical strings stored once.
+
+#define OTP_TABLE_ECC   0x01u
+#define OTP_TABLE_CRIT  0x02u
+
+#define OTP_TABLE_NO_REG 0xffffu
+
+#define OTP_TABLE_MAX_GRAM 3
+
+struct otp_table_field {
+    uint32_t mask;
+    uint32_t name;
+    uint32_t upper_name;
+    uint32_t description;
+};
+
+struct otp_table_reg {
+    uint32_t row;
+    uint32_t mask;
+    uint32_t name;
+    uint32_t upper_name;
+    uint32_t description;
+    uint32_t seq_prefix;
+    uint16_t first_field;
+    uint8_t field_count;
+    uint8_t flags;
+    uint8_t redundancy;
+    uint8_t seq_index;
+    uint8_t seq_length;
+};
+
+// The registers whose upper-case names contain a gram (a substring of 1 to OTP_TABLE_MAX_GRAM characters, see
+// otp_table_gram_key): count entries of otp_table_gram_postings from first, each an index into otp_table_regs,
+// in ascending order. The grams are sorted by key.
+struct otp_table_gram {
+    uint32_t key;
+    uint32_t first;
+    uint32_t count;
+};
+
+// A gram packed into a key, with its length in the top byte
+static inline uint32_t otp_table_gram_key(const char *s, size_t len) {
+    uint32_t key = (uint32_t)len << 24;
+    for (size_t i = 0; i < len; i++) {
+        key |= (uint32_t)(uint8_t)s[i] << (16 - 8 * i);
+    }
+    return key;
+}
+
+// Hash used for the upper-case register name index. Lookup is two-level (hash and displace): the name
+// hashed with seed 0 picks a bucket, and the name hashed with that bucket's seed picks a slot holding
+// the register index, so every lookup is two hashes and one string compare.
+static inline uint32_t otp_table_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 0x811c9dc5u ^ (seed * 0x9e3779b9u);
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 0x01000193u;
+    }
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+#endif
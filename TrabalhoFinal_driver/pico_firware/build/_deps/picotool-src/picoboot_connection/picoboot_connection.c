@@ -10,6 +10,7 @@
 #include <inttypes.h>
 
 #include "picoboot_connection.h"
+#include "crc32.h"
 #include "boot/bootrom_constants.h"
 #include "pico/stdio_usb/reset_interface.h"
 
@@ -30,29 +31,8 @@ static enum {
 
 // todo test sparse binary (well actually two range is this)
 
-uint32_t crc32_for_byte(uint32_t remainder) {
-    const uint32_t POLYNOMIAL = 0x4C11DB7;
-    remainder <<= 24u;
-    for (unsigned int bit = 8; bit > 0; bit--) {
-        if (remainder & 0x80000000)
-            remainder = (remainder << 1) ^ POLYNOMIAL;
-        else
-            remainder = (remainder << 1);
-    }
-    return remainder;
-}
-
 uint32_t crc32_sw(const uint8_t *buf, unsigned int count, uint32_t crc) {
-    static uint32_t table[0x100];
-    if (!table[1]) {
-        for (unsigned int i = 0; i < count_of(table); i++) {
-            table[i] = crc32_for_byte(i);
-        }
-    }
-    for (unsigned int i = 0; i < count; ++i) {
-        crc = (crc << 8u) ^ table[(uint8_t) ((crc >> 24u) ^ buf[i])];
-    }
-    return crc;
+    return crc32_msb_update(crc, buf, count);
 }
 
 unsigned int interface;
@@ -728,4 +708,73 @@ flash_id_return:
     picoboot_exclusive_access(usb_device, 0);
     return ret;
 }
+
+// Entry point appended to flash_id_bin, which reuses its flash_do_cmd to run two flash commands: the JEDEC ID,
+// then an SFDP read. Each command is sent from, and its response read back into, the same buffer
+//
+//   98:   b500        push    {lr}
+//   9a:   4805        ldr     r0, [pc, #20]   @ (b0 <jedec_buf_addr>)
+//   9c:   0001        movs    r1, r0
+//   9e:   4a05        ldr     r2, [pc, #20]   @ (b4 <jedec_len>)
+//   a0:   f7ff ffc4   bl      2c <flash_do_cmd>
+//   a4:   4804        ldr     r0, [pc, #16]   @ (b8 <sfdp_buf_addr>)
+//   a6:   0001        movs    r1, r0
+//   a8:   4a04        ldr     r2, [pc, #16]   @ (bc <sfdp_len>)
+//   aa:   f7ff ffbf   bl      2c <flash_do_cmd>
+//   ae:   bd00        pop     {pc}
+//   b0:   .word   jedec_buf_addr
+//   b4:   .word   jedec_len
+//   b8:   .word   sfdp_buf_addr
+//   bc:   .word   sfdp_len
+//   c0:   jedec_buf (4 bytes)
+//   c4:   sfdp_buf (5 + PICOBOOT_FLASH_SFDP_SIZE bytes)
+static const uint8_t picoboot_flash_sfdp_cmd[] = {
+        0x00, 0xb5, 0x05, 0x48, 0x01, 0x00, 0x05, 0x4a, 0xff, 0xf7, 0xc4, 0xff,
+        0x04, 0x48, 0x01, 0x00, 0x04, 0x4a, 0xff, 0xf7, 0xbf, 0xff, 0x00, 0xbd
+};
+#define FLASH_SFDP_ENTRY_OFFSET 0x98
+#define FLASH_SFDP_LITERALS_OFFSET 0xb0
+#define FLASH_SFDP_JEDEC_OFFSET 0xc0
+#define FLASH_SFDP_JEDEC_LEN 4      // 0x9f, then 3 ID bytes
+#define FLASH_SFDP_SFDP_OFFSET (FLASH_SFDP_JEDEC_OFFSET + FLASH_SFDP_JEDEC_LEN)
+#define FLASH_SFDP_SFDP_HDR_LEN 5   // 0x5a, 3 address bytes and a dummy byte
+#define FLASH_SFDP_PROG_SIZE (FLASH_SFDP_SFDP_OFFSET + FLASH_SFDP_SFDP_HDR_LEN + PICOBOOT_FLASH_SFDP_SIZE)
+
+int picoboot_flash_sfdp(libusb_device_handle *usb_device, uint8_t jedec_id[3], uint8_t *sfdp) {
+    // the bl instructions above assume the flash_id_bin layout: 0x98 bytes, with "b.n 2c <flash_do_cmd>" at 6
+    if (flash_id_bin_SIZE != FLASH_SFDP_ENTRY_OFFSET || flash_id_bin[6] != 0x11 || flash_id_bin[7] != 0xe0) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+    uint8_t prog[FLASH_SFDP_PROG_SIZE];
+    output("GET FLASH SFDP\n");
+    memset(prog, 0, sizeof(prog));
+    memcpy(prog, flash_id_bin, flash_id_bin_SIZE);
+    memcpy(prog + FLASH_SFDP_ENTRY_OFFSET, picoboot_flash_sfdp_cmd, sizeof(picoboot_flash_sfdp_cmd));
+    uint32_t *literals = (uint32_t *)(prog + FLASH_SFDP_LITERALS_OFFSET);
+    literals[0] = FLASH_ID_CODE_LOC + FLASH_SFDP_JEDEC_OFFSET;
+    literals[1] = FLASH_SFDP_JEDEC_LEN;
+    literals[2] = FLASH_ID_CODE_LOC + FLASH_SFDP_SFDP_OFFSET;
+    literals[3] = FLASH_SFDP_SFDP_HDR_LEN + PICOBOOT_FLASH_SFDP_SIZE;
+    prog[FLASH_SFDP_JEDEC_OFFSET] = 0x9f;
+    prog[FLASH_SFDP_SFDP_OFFSET] = 0x5a; // address 0
+
+    // ensure XIP is exited before executing
+    int ret = picoboot_exit_xip(usb_device);
+    if (ret)
+        return ret;
+    // only the program and commands need writing, as the data phase of each command ignores what is sent
+    ret = picoboot_write(usb_device, FLASH_ID_CODE_LOC, prog, FLASH_SFDP_SFDP_OFFSET + FLASH_SFDP_SFDP_HDR_LEN);
+    if (ret)
+        return ret;
+    ret = picoboot_exec(usb_device, FLASH_ID_CODE_LOC + FLASH_SFDP_ENTRY_OFFSET);
+    if (ret)
+        return ret;
+    ret = picoboot_read(usb_device, FLASH_ID_CODE_LOC + FLASH_SFDP_JEDEC_OFFSET, prog + FLASH_SFDP_JEDEC_OFFSET,
+                        FLASH_SFDP_PROG_SIZE - FLASH_SFDP_JEDEC_OFFSET);
+    if (ret)
+        return ret;
+    memcpy(jedec_id, prog + FLASH_SFDP_JEDEC_OFFSET + 1, 3);
+    memcpy(sfdp, prog + FLASH_SFDP_SFDP_OFFSET + FLASH_SFDP_SFDP_HDR_LEN, PICOBOOT_FLASH_SFDP_SIZE);
+    return 0;
+}
 #endif
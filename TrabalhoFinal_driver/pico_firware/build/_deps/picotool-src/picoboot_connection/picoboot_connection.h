@@ -77,6 +77,9 @@ int picoboot_otp_read(libusb_device_handle *usb_device, struct picoboot_otp_cmd
 int picoboot_poke(libusb_device_handle *usb_device, uint32_t addr, uint32_t data);
 int picoboot_peek(libusb_device_handle *usb_device, uint32_t addr, uint32_t *data);
 int picoboot_flash_id(libusb_device_handle *usb_device, uint64_t *data);
+// Reads the 3 byte JEDEC ID and the first PICOBOOT_FLASH_SFDP_SIZE bytes of the SFDP tables (RP2040 only)
+#define PICOBOOT_FLASH_SFDP_SIZE 512
+int picoboot_flash_sfdp(libusb_device_handle *usb_device, uint8_t jedec_id[3], uint8_t *sfdp);
 #endif
 
 // we require 256 (as this is the page size supported by the device)
@@ -52,6 +52,23 @@ const char *command_failure::what() const noexcept {
     }
 }
 
+std::map<libusb_device_handle *, std::weak_ptr<picoboot::device_cache>> connection::device_caches;
+picoboot::cache_stats connection::stats;
+
+std::shared_ptr<picoboot::device_cache> connection::get_device_cache(libusb_device_handle *device) {
+    auto cache = device_caches[device].lock();
+    if (!cache) {
+        // forget the handles which no longer have any connections
+        for (auto it = device_caches.begin(); it != device_caches.end();) {
+            if (it->second.expired()) it = device_caches.erase(it);
+            else it++;
+        }
+        cache = std::make_shared<device_cache>();
+        device_caches[device] = cache;
+    }
+    return cache;
+}
+
 template <typename F> void connection::wrap_call(F&& func) {
     int rc = func();
 #if 0
@@ -92,19 +109,43 @@ void connection::exit_xip() {
     wrap_call([&] { return picoboot_exit_xip(device); });
 }
 
+void connection::invalidate_cache() {
+    cache->info.clear();
+}
+
 void connection::reboot(uint32_t pc, uint32_t sp, uint32_t delay_ms) {
+    invalidate_cache();
     wrap_call([&] { return picoboot_reboot(device, pc, sp, delay_ms); });
 }
 
 void connection::reboot2(struct picoboot_reboot2_cmd *cmd) {
+    invalidate_cache();
     wrap_call([&] { return picoboot_reboot2(device, cmd); });
 }
 
 void connection::get_info(struct picoboot_get_info_cmd *get_info_cmd, uint8_t *buffer, uint32_t len) {
+    // the partition table and the target partition only change when flash is written or the device reboots
+    if (get_info_cmd->bType != PICOBOOT_GET_INFO_PARTTION_TABLE &&
+        get_info_cmd->bType != PICOBOOT_GET_INFO_UF2_TARGET_PARTITION) {
+        wrap_call([&] { return picoboot_get_info(device, get_info_cmd, buffer, len); });
+        return;
+    }
+    std::vector<uint8_t> key((uint8_t *)get_info_cmd, (uint8_t *)(get_info_cmd + 1));
+    key.insert(key.end(), (uint8_t *)&len, (uint8_t *)(&len + 1));
+    auto cached = cache->info.find(key);
+    if (cached != cache->info.end()) {
+        std::copy(cached->second.begin(), cached->second.end(), buffer);
+        stats.hits++;
+        return;
+    }
     wrap_call([&] { return picoboot_get_info(device, get_info_cmd, buffer, len); });
+    cache->info[key] = std::vector<uint8_t>(buffer, buffer + len);
+    stats.misses++;
 }
 
 void connection::exec(uint32_t addr) {
+    // the code may have done anything, including writing flash
+    invalidate_cache();
     wrap_call([&] { return picoboot_exec(device, addr); });
 }
 
@@ -113,6 +154,7 @@ void connection::exec(uint32_t addr) {
 // } // currently unused
 
 void connection::flash_erase(uint32_t addr, uint32_t len) {
+    invalidate_cache();
     wrap_call([&] { return picoboot_flash_erase(device, addr, len); });
 }
 
@@ -121,19 +163,36 @@ void connection::vector(uint32_t addr) {
 }
 
 void connection::write(uint32_t addr, uint8_t *buffer, uint32_t len) {
+    if (get_memory_type(addr, model) == flash) invalidate_cache();
     wrap_call([&] { return picoboot_write(device, addr, buffer, len); });
 }
 
 void connection::read(uint32_t addr, uint8_t *buffer, uint32_t len) {
+    // the boot ROM never changes, so each ROM range is only read once
+    bool rom_read = len && get_memory_type(addr, model) == rom && get_memory_type(addr + len - 1, model) == rom;
+    if (rom_read) {
+        auto cached = cache->rom.find(std::make_pair(addr, len));
+        if (cached != cache->rom.end()) {
+            std::copy(cached->second.begin(), cached->second.end(), buffer);
+            stats.hits++;
+            return;
+        }
+    }
     // Workaround due to picoboot interface not supporting reads over 4MiB
     uint32_t max_chunk_size = 0x00400000;
     for (uint32_t i=0; i < len; i += max_chunk_size) {
         uint32_t read_size = std::min(len - i, max_chunk_size);
         wrap_call([&] { return picoboot_read(device, addr + i, buffer + i, read_size); });
     }
+    if (rom_read) {
+        cache->rom[std::make_pair(addr, len)] = std::vector<uint8_t>(buffer, buffer + len);
+        stats.misses++;
+    }
 }
 
 void connection::otp_write(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len) {
+    // OTP settings such as the flash partition slot size affect how the partition table is found
+    invalidate_cache();
     wrap_call([&] { return picoboot_otp_write(device, otp_cmd, buffer, len); });
 }
 
@@ -144,3 +203,50 @@ void connection::otp_read(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uin
 void connection::flash_id(uint64_t &data) {
     wrap_call([&] { return picoboot_flash_id(device, &data); });
 }
+
+static uint32_t sfdp_word(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+const picoboot::flash_geometry &connection::get_flash_geometry() {
+    if (geometry_read) return geometry;
+    geometry_read = true;
+    if (model != rp2040) return geometry; // the SFDP helper uses the RP2040 SSI
+    uint8_t id[3];
+    uint8_t sfdp[PICOBOOT_FLASH_SFDP_SIZE];
+    try {
+        wrap_call([&] { return picoboot_flash_sfdp(device, id, sfdp); });
+    } catch (std::exception &) {
+        return geometry;
+    }
+    geometry.jedec_id = (id[0] << 16) | (id[1] << 8) | id[2];
+    // JESD216: "SFDP" signature, then the parameter headers; the first is always the basic flash parameter table
+    if (sfdp_word(sfdp) != 0x50444653) return geometry;
+    const uint8_t *param = sfdp + 8;
+    if (param[0] != 0x00 || param[7] != 0xff) return geometry;
+    uint32_t dwords = param[3];
+    uint32_t table = param[4] | (param[5] << 8) | (param[6] << 16);
+    if (dwords < 2 || table + dwords * 4 > sizeof(sfdp)) return geometry;
+    auto dword = [&](unsigned int n) { return sfdp_word(sfdp + table + (n - 1) * 4); };
+
+    uint32_t density = dword(2);
+    if (density & 0x80000000u) {
+        uint32_t log2_bits = density & 0x7fffffffu;
+        if (log2_bits >= 3 && log2_bits < 35) geometry.size = (uint32_t)(1ull << (log2_bits - 3));
+    } else {
+        geometry.size = (uint32_t)((density + 1ull) / 8);
+    }
+    if ((dword(1) & 3) == 1) geometry.erase_sizes |= 1u << 12;
+    if (dwords >= 9) {
+        // erase types 1-4, as (log2 size, opcode) byte pairs
+        uint32_t types[2] = {dword(8), dword(9)};
+        for (unsigned int i = 0; i < 4; i++) {
+            uint8_t log2_size = types[i / 2] >> (16 * (i % 2));
+            if (log2_size && log2_size < 32) geometry.erase_sizes |= 1u << log2_size;
+        }
+    }
+    if (dwords >= 11) {
+        geometry.page_size = 1u << ((dword(11) >> 4) & 0xf);
+    }
+    return geometry;
+}
@@ -9,6 +9,8 @@
 
 #include "picoboot_connection.h"
 #include <vector>
+#include <map>
+#include <memory>
 
 namespace picoboot {
 
@@ -27,8 +29,28 @@ namespace picoboot {
         const int libusb_code;
     };
 
+    // Flash details from its JEDEC ID and SFDP tables; fields are 0 when not known
+    struct flash_geometry {
+        uint32_t jedec_id = 0;      // manufacturer, memory type and capacity bytes
+        uint32_t size = 0;          // in bytes
+        uint32_t page_size = 0;     // in bytes
+        uint32_t erase_sizes = 0;   // bit n is set if 2^n byte erases are supported
+    };
+
+    // Device replies that are kept while there are connections to the device handle, so that repeated lookups
+    // of the partition table, target partition, and boot ROM contents are only sent over USB once
+    struct device_cache {
+        std::map<std::vector<uint8_t>, std::vector<uint8_t>> info;  // keyed on the GET_INFO command and length
+        std::map<std::pair<uint32_t, uint32_t>, std::vector<uint8_t>> rom;  // keyed on address and length
+    };
+
+    struct cache_stats {
+        unsigned int hits = 0;      // requests answered without a round trip
+        unsigned int misses = 0;    // cacheable requests that went to the device
+    };
+
     struct connection {
-        explicit connection(libusb_device_handle *device, model_t model, bool exclusive = true) : device(device), model(model), exclusive(exclusive) {
+        explicit connection(libusb_device_handle *device, model_t model, bool exclusive = true) : device(device), model(model), exclusive(exclusive), cache(get_device_cache(device)) {
             // do a device reset in case it was left in a bad state
             reset();
             if (exclusive) exclusive_access(EXCLUSIVE);
@@ -60,6 +82,12 @@ namespace picoboot {
         void otp_write(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len);
         void otp_read(struct picoboot_otp_cmd *otp_cmd, uint8_t *buffer, uint32_t len);
         void flash_id(uint64_t &data);
+        // Read from the device the first time it is needed for this connection
+        const flash_geometry &get_flash_geometry();
+
+        // Drop cached replies that a flash write or reboot may have changed
+        void invalidate_cache();
+        static const cache_stats &get_cache_stats() { return stats; }
 
         model_t get_model() const { return model; }
         std::vector<uint8_t> read_bytes(uint32_t addr, uint32_t len) {
@@ -72,6 +100,14 @@ namespace picoboot {
         libusb_device_handle *device;
         model_t model;
         bool exclusive;
+        flash_geometry geometry;
+        bool geometry_read = false;
+        // Shared by all the connections to the device handle, and freed with the last of them, which is before the
+        // handle can be closed; so a later handle at the same address always starts with an empty cache
+        std::shared_ptr<device_cache> cache;
+        static std::shared_ptr<device_cache> get_device_cache(libusb_device_handle *device);
+        static std::map<libusb_device_handle *, std::weak_ptr<device_cache>> device_caches;
+        static cache_stats stats;
     };
 
 }
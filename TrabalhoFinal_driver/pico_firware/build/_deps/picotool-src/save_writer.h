@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "errors.h"
+
+// Formats and writes the output of save on its own thread, so the device is read while the file is written. Each
+// chunk read is passed to writer256 a page at a time, which hands the file data back to write(); this is collected
+// into buffer_size buffers, written in order at buffer_size aligned offsets in the file
+struct save_writer {
+    // Runs on the writer thread, which has its own default settings (they are per thread), so anything it needs
+    // from the command's settings must be captured by value
+    typedef std::function<void(save_writer &out, const uint8_t *buffer, unsigned int size, unsigned int offset)> page_writer;
+    static constexpr uint32_t page_size = 256;
+    static constexpr uint32_t buffer_size = 0x100000;
+    static constexpr size_t max_queued = 8;
+
+    save_writer(FILE *out, page_writer writer256) : out(out), writer256(std::move(writer256)) {
+        buffer.reserve(buffer_size);
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~save_writer() {
+        if (thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                cv.notify_all();
+            }
+            thread.join();
+        }
+    }
+
+    save_writer(const save_writer&) = delete;
+    save_writer& operator=(const save_writer&) = delete;
+
+    // Queue data read at offset from the start of the range being saved; waits while max_queued chunks are pending
+    void add(uint32_t offset, std::vector<uint8_t> &&data) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return queue.size() < max_queued || error; });
+        if (error) std::rethrow_exception(error);
+        queue.emplace_back(offset, std::move(data));
+        cv.notify_all();
+    }
+
+    // Write out everything queued
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finishing = true;
+            cv.notify_all();
+        }
+        thread.join();
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Called by writer256 with file data at file_offset
+    void write(uint32_t file_offset, const void *data, uint32_t len) {
+        if (!buffer.empty() && file_offset != buffer_offset + buffer.size()) flush();
+        if (buffer.empty()) buffer_offset = file_offset;
+        auto *p = (const uint8_t *)data;
+        while (len) {
+            uint32_t end = buffer_offset + buffer.size();
+            uint32_t this_len = std::min(len, buffer_size - end % buffer_size);
+            buffer.insert(buffer.end(), p, p + this_len);
+            p += this_len;
+            len -= this_len;
+            if (!((end + this_len) % buffer_size)) {
+                flush();
+                buffer_offset = end + this_len;
+            }
+        }
+    }
+
+private:
+    void run() {
+        try {
+            while (true) {
+                std::pair<uint32_t, std::vector<uint8_t>> chunk;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return !queue.empty() || finishing || stopping; });
+                    if (stopping) return;
+                    if (queue.empty()) break;
+                    chunk = std::move(queue.front());
+                    queue.pop_front();
+                    cv.notify_all();
+                }
+                for (uint32_t pos = 0; pos < chunk.second.size(); pos += page_size) {
+                    uint32_t this_size = std::min((uint32_t)page_size, (uint32_t)chunk.second.size() - pos);
+                    writer256(*this, chunk.second.data() + pos, this_size, chunk.first + pos);
+                }
+            }
+            flush();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            cv.notify_all();
+        }
+    }
+
+    void flush() {
+        if (buffer.empty()) return;
+        if (file_pos != buffer_offset && fseek(out, buffer_offset, SEEK_SET)) {
+            fail(ERROR_WRITE_FAILED, "Failed to write output file");
+        }
+        if (1 != fwrite(buffer.data(), buffer.size(), 1, out)) {
+            fail(ERROR_WRITE_FAILED, "Failed to write output file");
+        }
+        file_pos = buffer_offset + buffer.size();
+        buffer.clear();
+    }
+
+    FILE *out;
+    page_writer writer256;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<uint32_t, std::vector<uint8_t>>> queue;
+    bool finishing = false;
+    bool stopping = false;
+    std::exception_ptr error;
+    std::vector<uint8_t> buffer;
+    uint32_t buffer_offset = 0;
+    uint32_t file_pos = 0;
+};
+
+// Writes a BIN, with each page at its offset in the file. With sparse, pages of zeros are left as holes, except at
+// the end where the file size must be set
+inline save_writer::page_writer bin_page_writer(uint32_t size, bool sparse) {
+    return [size, sparse](save_writer &out, const uint8_t *buffer, unsigned int actual_size, unsigned int offset) {
+        if (sparse && offset + actual_size < size &&
+            std::all_of(buffer, buffer + actual_size, [](uint8_t b) { return !b; })) {
+            return;
+        }
+        out.write(offset, buffer, actual_size);
+    };
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2024 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Checks the BIN output of save: the data must come out unchanged, and with --sparse, pages of zeros must be left as
+// holes (not written at all), apart from the last page, which sets the file size
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "save_writer.h"
+
+static const uint32_t page_size = save_writer::page_size;
+
+// Contents of the range being saved: some pages of zeros, at the start, in the middle, across a buffer boundary,
+// and at the end
+static std::vector<uint8_t> test_data(uint32_t size) {
+    std::vector<uint8_t> data(size);
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t page = i / page_size;
+        bool zero = page == 0 || page % 7 == 3 || (i >= save_writer::buffer_size - page_size && i < save_writer::buffer_size + page_size) ||
+                    i >= size - page_size;
+        data[i] = zero ? 0 : (uint8_t)(i * 31 + 1);
+    }
+    return data;
+}
+
+// Saves data through save_writer in chunks of chunk_size, into out starting at position 0
+static bool save(FILE *out, const std::vector<uint8_t> &data, uint32_t chunk_size, bool sparse) {
+    try {
+        save_writer writer(out, bin_page_writer(data.size(), sparse));
+        for (uint32_t pos = 0; pos < data.size(); pos += chunk_size) {
+            uint32_t len = std::min(chunk_size, (uint32_t)data.size() - pos);
+            writer.add(pos, std::vector<uint8_t>(data.begin() + pos, data.begin() + pos + len));
+        }
+        writer.finish();
+    } catch (std::exception &e) {
+        printf("save failed: %s\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+static std::vector<uint8_t> read_back(FILE *f) {
+    std::vector<uint8_t> contents;
+    fseek(f, 0, SEEK_END);
+    contents.resize(ftell(f));
+    rewind(f);
+    if (!contents.empty() && fread(contents.data(), contents.size(), 1, f) != 1) contents.clear();
+    return contents;
+}
+
+int main() {
+    // 3.5 buffers, with a short last page, in chunks that don't divide the buffer size
+    const uint32_t size = 3 * save_writer::buffer_size + save_writer::buffer_size / 2 + 100;
+    const uint32_t chunk_size = 0x9000;
+    auto data = test_data(size);
+    int failures = 0;
+
+    for (bool sparse : {false, true}) {
+        FILE *f = tmpfile();
+        if (!f || !save(f, data, chunk_size, sparse)) return 1;
+        if (read_back(f) != data) {
+            printf("FAILED: %s BIN contents differ from the data saved\n", sparse ? "sparse" : "non-sparse");
+            failures++;
+        }
+        fclose(f);
+    }
+
+    // Fill the file first, so that the pages which were not written can be told apart from those that were
+    FILE *f = tmpfile();
+    std::vector<uint8_t> fill(size, 0xaa);
+    if (!f || fwrite(fill.data(), size, 1, f) != 1) return 1;
+    rewind(f);
+    if (!save(f, data, chunk_size, true)) return 1;
+    auto contents = read_back(f);
+    fclose(f);
+    if (contents.size() != size) {
+        printf("FAILED: sparse BIN is %zu bytes, expected %u\n", contents.size(), size);
+        return 1;
+    }
+    uint32_t holes = 0;
+    for (uint32_t pos = 0; pos < size; pos += page_size) {
+        uint32_t len = std::min(page_size, size - pos);
+        bool zero = std::all_of(data.begin() + pos, data.begin() + pos + len, [](uint8_t b) { return !b; });
+        bool last = pos + len == size;
+        const uint8_t *expected = zero && !last ? fill.data() : data.data() + pos;
+        if (memcmp(contents.data() + pos, expected, len)) {
+            printf("FAILED: sparse BIN page at 0x%x was %s\n", pos, zero && !last ? "written" : "not written correctly");
+            failures++;
+        }
+        if (zero && !last) holes++;
+    }
+    if (!holes) {
+        printf("FAILED: test data has no pages of zeros\n");
+        failures++;
+    }
+    if (!failures) printf("OK: %u of %u pages left as holes\n", holes, (size + page_size - 1) / page_size);
+    return failures ? 1 : 0;
+}